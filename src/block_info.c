@@ -31,6 +31,8 @@
 #include <assert.h>
 #include "block_info.h"
 
+size_t bi_pool_spills = 0;
+
 
 /**
  * reset the block_info struct
@@ -39,16 +41,33 @@
 void
 bi_clear(struct block_info_t* block_info)
 {
-  if (block_info->samples)
-    free(block_info->samples);
+  // preallocated storage is kept, so that it can be reused
+  if (!block_info->pooled)
+    {
+      free(block_info->samples);
+      block_info->samples = NULL;
+      block_info->samples_size = 0;
+    }
 
-  block_info->samples = NULL;
   block_info->samples_len = 0;
   block_info->valid = 0;
   block_info->last = 0.0;
   block_info->decile = 0.0;
 }
 
+/**
+ * mark block_info as initialised without any samples, storage attached with
+ * bi_attach() is kept, so that following samples don't need allocations
+ */
+static void
+_bi_start(struct block_info_t* block_info)
+{
+  bi_clear(block_info);
+  block_info->error = 0;
+  block_info->timeout = 0;
+  block_info->initialized = 1;
+}
+
 /**
  * initialises the block_info_t struct
  */
@@ -57,13 +76,64 @@ bi_init(struct block_info_t* block_info)
 {
   block_info->samples = NULL;
   block_info->samples_len = 0;
+  block_info->samples_size = 0;
+  block_info->pooled = 0;
   block_info->valid = 0;
   block_info->error = 0;
+  block_info->timeout = 0;
   block_info->last = 0;
   block_info->decile = 0.0;
   block_info->initialized = 0;
 }
 
+/**
+ * use preallocated storage for samples
+ */
+void
+bi_attach(struct block_info_t* block_info, double* storage, size_t size)
+{
+  assert(block_info->samples_len == 0);
+
+  if (!block_info->pooled)
+    free(block_info->samples);
+
+  block_info->samples = storage;
+  block_info->samples_size = size;
+  block_info->pooled = 1;
+}
+
+/**
+ * make room for at least size samples
+ */
+void
+bi_reserve(struct block_info_t* block_info, size_t size)
+{
+  double* samples;
+
+  if (size <= block_info->samples_size)
+    return;
+
+  if (block_info->pooled)
+    {
+      samples = malloc(sizeof(double) * size);
+      if (!samples)
+        err(1, "bi_reserve");
+      memcpy(samples, block_info->samples,
+          sizeof(double) * block_info->samples_len);
+      block_info->pooled = 0;
+      bi_pool_spills++;
+    }
+  else
+    {
+      samples = realloc(block_info->samples, sizeof(double) * size);
+      if (!samples)
+        err(1, "bi_reserve");
+    }
+
+  block_info->samples = samples;
+  block_info->samples_size = size;
+}
+
 /**
  */
 inline int
@@ -86,12 +156,13 @@ bi_is_initialised(struct block_info_t* block_info)
 void
 bi_add_time(struct block_info_t* block_info, double time)
 {
+  // grow geometrically, blocks are read many times
+  if (block_info->samples_len == block_info->samples_size)
+    bi_reserve(block_info, (block_info->samples_size) ?
+        block_info->samples_size * 2 : 1);
+
   if (block_info->samples_len == 0)
     {
-      block_info->samples = malloc(sizeof(double));
-      if (!block_info->samples)
-        err(1, "bi_add_time");
-
       block_info->samples[0] = time;
       block_info->samples_len = 1;
       block_info->last = time;
@@ -101,12 +172,6 @@ bi_add_time(struct block_info_t* block_info, double time)
   else
     {
       block_info->samples_len++;
-      block_info->samples = realloc(block_info->samples,
-          sizeof(double) * block_info->samples_len);
-
-      if (!block_info->samples)
-        err(1, "bi_add_time");
-
       block_info->samples[block_info->samples_len-1] = time;
       block_info->last = time;
       block_info->decile = 0.0;
@@ -123,12 +188,10 @@ bi_add(struct block_info_t* sum, struct block_info_t* adder)
   if (adder->samples_len == 0)
     return;
 
+  bi_reserve(sum, sum->samples_len + adder->samples_len);
+
   if (sum->samples_len == 0)
     {
-      sum->samples = malloc(sizeof(double)*adder->samples_len);
-      if (!sum->samples)
-        err(1, "bi_add");
-
       memcpy(sum->samples, adder->samples, sizeof(double) * adder->samples_len);
 
       sum->samples_len = adder->samples_len;
@@ -137,12 +200,6 @@ bi_add(struct block_info_t* sum, struct block_info_t* adder)
     }
   else
     {
-      sum->samples = realloc(sum->samples, sizeof(double)*(
-            sum->samples_len + adder->samples_len));
-
-      if (!sum->samples)
-        err(1, "bi_add");
-
       for(size_t i=0; i< adder->samples_len; i++)
         sum->samples[sum->samples_len + i] = adder->samples[i];
 
@@ -151,8 +208,9 @@ bi_add(struct block_info_t* sum, struct block_info_t* adder)
       sum->decile = 0.0;
     }
 
-  sum->initialized &= adder->initialized;
+  sum->initialized |= adder->initialized;
   sum->error += adder->error;
+  sum->timeout += adder->timeout;
 
   return;
 }
@@ -171,6 +229,7 @@ bi_add_valid(struct block_info_t* sum, struct block_info_t* adder)
   else if (sum->valid == 1 && adder->valid != 1)
     {
       sum->error += adder->error;
+      sum->timeout += adder->timeout;
     }
   else // (sum->valid != 1 && adder->valid == 1)
     {
@@ -201,8 +260,12 @@ bi_remove_last(struct block_info_t* block_info)
     }
   else
     {
-      free(block_info->samples);
-      block_info->samples = NULL;
+      if (!block_info->pooled)
+        {
+          free(block_info->samples);
+          block_info->samples = NULL;
+          block_info->samples_size = 0;
+        }
       block_info->samples_len = 0;
       block_info->last = 0.0;
       block_info->decile = 0.0;
@@ -661,10 +724,7 @@ void
 bi_add_error(struct block_info_t* block_info)
 {
   if (!bi_is_initialised(block_info))
-    {
-        bi_init(block_info);
-        block_info->initialized = 1;
-    }
+    _bi_start(block_info);
   block_info->error++;
 }
 
@@ -677,3 +737,23 @@ bi_get_error(struct block_info_t* block_info)
   return block_info->error;
 }
 
+/**
+ * set that a read of the block didn't finish in time
+ */
+void
+bi_add_timeout(struct block_info_t* block_info)
+{
+  if (!bi_is_initialised(block_info))
+    _bi_start(block_info);
+  block_info->timeout++;
+}
+
+/**
+ * get number of reads of the block that didn't finish in time
+ */
+int
+bi_get_timeout(struct block_info_t* block_info)
+{
+  return block_info->timeout;
+}
+
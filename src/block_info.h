@@ -32,15 +32,25 @@
 /// information about a single block (256 sectors by default)
 struct block_info_t {
     char initialized;
+    char pooled; ///< samples are part of a bigger allocation, not freed
     double* samples; ///< measurements for the block
     size_t samples_len; ///< number of samples taken
+    size_t samples_size; ///< number of samples that fit in samples
     short int valid; ///< 0 if data is invalid (because read was interrupted)
     unsigned short int error; ///< number of IO errors that occurred while
                               /// reading the block
+    unsigned short int timeout; ///< number of reads of the block that didn't
+                                /// finish in time
     double last; ///< last sample collected
     double decile; ///< saved 9th decile
 };
 
+/**
+ * number of blocks whose samples outgrew storage attached with bi_attach()
+ * and were moved to a normal allocation
+ */
+extern size_t bi_pool_spills;
+
 /**
  * reset the block_info struct
  * does not reset number of block errors!
@@ -54,6 +64,19 @@ bi_clear(struct block_info_t* block_info);
 void
 bi_init(struct block_info_t* block_info);
 
+/**
+ * use preallocated storage for samples, it's not freed by bi_clear();
+ * samples that don't fit in it are moved to a normal allocation
+ */
+void
+bi_attach(struct block_info_t* block_info, double* storage, size_t size);
+
+/**
+ * make room for at least size samples
+ */
+void
+bi_reserve(struct block_info_t* block_info, size_t size);
+
 /**
  * checks if block_info had been initialised (whatever any data has been
  * written to it)
@@ -215,4 +238,16 @@ bi_add_error(struct block_info_t* block_info);
 int
 bi_get_error(struct block_info_t* block_info) PURE_FUNCTION;
 
+/**
+ * set that a read of the block didn't finish in time
+ */
+void
+bi_add_timeout(struct block_info_t* block_info);
+
+/**
+ * get number of reads of the block that didn't finish in time
+ */
+int
+bi_get_timeout(struct block_info_t* block_info) PURE_FUNCTION;
+
 #endif
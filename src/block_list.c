@@ -0,0 +1,250 @@
+/** hdck - hard drive low-level error and badsector checking
+ *
+ * Copyright (C) 2010  Hubert Kario
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <err.h>
+#include <assert.h>
+#include <sys/types.h>
+#include "block_list.h"
+
+/**
+ * initialise empty list
+ */
+void
+br_init(struct block_ranges_t* list)
+{
+  list->ranges = NULL;
+  list->len = 0;
+  list->alloc = 0;
+}
+
+/**
+ * free memory used by the list, leaving it empty
+ */
+void
+br_free(struct block_ranges_t* list)
+{
+  free(list->ranges);
+  br_init(list);
+}
+
+/**
+ * remove all entries from the list, keeping the memory for reuse
+ */
+void
+br_clear(struct block_ranges_t* list)
+{
+  list->len = 0;
+}
+
+/**
+ * append range of len blocks starting at off to the list
+ */
+void
+br_add(struct block_ranges_t* list, off_t off, off_t len)
+{
+  assert(off >= 0 && len >= 0 && off + len <= BLOCK_NO_MAX);
+
+  if (list->len == list->alloc)
+    {
+      list->alloc = (list->alloc) ? list->alloc * 2 : 16;
+      list->ranges = realloc(list->ranges,
+          sizeof(struct block_range_t) * list->alloc);
+      if (list->ranges == NULL)
+        err(EXIT_FAILURE, "br_add");
+    }
+
+  list->ranges[list->len].off = off;
+  list->ranges[list->len].len = len;
+  list->len++;
+}
+
+/**
+ * append block to the list, extending the last range if block follows it
+ */
+void
+br_extend(struct block_ranges_t* list, off_t block)
+{
+  if (list->len > 0 &&
+      (off_t)list->ranges[list->len-1].off + list->ranges[list->len-1].len
+        == block)
+    {
+      list->ranges[list->len-1].len++;
+      return;
+    }
+
+  br_add(list, block, 1);
+}
+
+static int
+_range_compare(const void *a, const void *b)
+{
+  block_no_t x, y;
+  x = ((struct block_range_t*)a)->off;
+  y = ((struct block_range_t*)b)->off;
+
+  if (x<y)
+    return -1;
+  else if (x==y)
+    return 0;
+  else
+    return 1;
+}
+
+/**
+ * sort the list by first block of ranges
+ */
+void
+br_sort(struct block_ranges_t* list)
+{
+  qsort(list->ranges, list->len, sizeof(struct block_range_t),
+      _range_compare);
+}
+
+/**
+ * merge ranges of a sorted list that overlap or start at most glob blocks
+ * after start of the previous range
+ */
+void
+br_compact(struct block_ranges_t* list, size_t glob)
+{
+  struct block_range_t *ranges = list->ranges;
+  size_t last = 0;
+
+  if (list->len == 0)
+    return;
+
+  for (size_t i=1; i < list->len; i++)
+    {
+      uint64_t end = (uint64_t)ranges[last].off + ranges[last].len;
+      uint64_t new_end = (uint64_t)ranges[i].off + ranges[i].len;
+
+      // check if the range isn't contained in the previous one
+      if (ranges[i].off < end)
+        {
+          // extend the previous one if they overlap only partially
+          if (new_end > end)
+            ranges[last].len = new_end - ranges[last].off;
+          continue;
+        }
+
+      // check if we can extend the last range to contain current one
+      if (ranges[i].off <= (uint64_t)ranges[last].off + glob)
+        {
+          ranges[last].len = new_end - ranges[last].off;
+          continue;
+        }
+
+      ranges[++last] = ranges[i];
+    }
+
+  list->len = last + 1;
+}
+
+/**
+ * return index of the first range of a sorted list that ends after block,
+ * len if there's no such range
+ */
+static size_t
+_range_search(struct block_ranges_t* list, off_t block)
+{
+  size_t lo = 0, hi = list->len;
+
+  while (lo < hi)
+    {
+      size_t mid = lo + (hi - lo) / 2;
+
+      if ((off_t)list->ranges[mid].off + list->ranges[mid].len <= block)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+
+  return lo;
+}
+
+/**
+ * check if block is in a sorted list of ranges that don't overlap
+ */
+int
+br_contains(struct block_ranges_t* list, off_t block)
+{
+  size_t i = _range_search(list, block);
+
+  return i < list->len && list->ranges[i].off <= block;
+}
+
+/**
+ * add block to a sorted list of ranges that don't overlap, keeping it sorted
+ * and merging the block with neighbouring ranges
+ */
+void
+br_insert(struct block_ranges_t* list, off_t block)
+{
+  struct block_range_t *ranges;
+  size_t i = _range_search(list, block);
+
+  if (i < list->len && list->ranges[i].off <= block)
+    return;
+
+  // extend the previous range
+  if (i > 0 && (off_t)list->ranges[i-1].off + list->ranges[i-1].len == block)
+    {
+      ranges = list->ranges;
+      ranges[i-1].len++;
+      // and merge it with the next one if the gap is closed
+      if (i < list->len && ranges[i].off == block + 1)
+        {
+          ranges[i-1].len += ranges[i].len;
+          memmove(&ranges[i], &ranges[i+1],
+              sizeof(struct block_range_t) * (list->len - i - 1));
+          list->len--;
+        }
+      return;
+    }
+
+  // extend the next range
+  if (i < list->len && list->ranges[i].off == block + 1)
+    {
+      list->ranges[i].off--;
+      list->ranges[i].len++;
+      return;
+    }
+
+  br_add(list, block, 1);
+  ranges = list->ranges;
+  memmove(&ranges[i+1], &ranges[i],
+      sizeof(struct block_range_t) * (list->len - i - 1));
+  ranges[i].off = block;
+  ranges[i].len = 1;
+}
+
+/**
+ * return total number of blocks in the list
+ */
+off_t
+br_blocks(struct block_ranges_t* list)
+{
+  off_t total = 0;
+
+  for (size_t i=0; i < list->len; i++)
+    total += list->ranges[i].len;
+
+  return total;
+}
@@ -0,0 +1,104 @@
+/** hdck - hard drive low-level error and badsector checking
+ *
+ * Copyright (C) 2010  Hubert Kario
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#ifndef __BLOCK_LIST_H
+#define __BLOCK_LIST_H 1
+
+#include <stdint.h>
+#include <sys/types.h>
+
+/// block number, with 256 sector blocks 32 bits cover 512 PiB
+typedef uint32_t block_no_t;
+/// largest device size, in blocks, that block ranges can describe
+#define BLOCK_NO_MAX UINT32_MAX
+
+/// range of consecutive blocks
+struct block_range_t {
+    block_no_t off; ///< first block of the range
+    block_no_t len; ///< number of blocks in the range
+};
+
+/// growable list of block ranges
+struct block_ranges_t {
+    struct block_range_t* ranges; ///< entries of the list
+    size_t len; ///< number of entries in the list
+    size_t alloc; ///< number of entries ranges has room for
+};
+
+/**
+ * initialise empty list
+ */
+void
+br_init(struct block_ranges_t* list);
+
+/**
+ * free memory used by the list, leaving it empty
+ */
+void
+br_free(struct block_ranges_t* list);
+
+/**
+ * remove all entries from the list, keeping the memory for reuse
+ */
+void
+br_clear(struct block_ranges_t* list);
+
+/**
+ * append range of len blocks starting at off to the list
+ */
+void
+br_add(struct block_ranges_t* list, off_t off, off_t len);
+
+/**
+ * append block to the list, extending the last range if block follows it
+ */
+void
+br_extend(struct block_ranges_t* list, off_t block);
+
+/**
+ * sort the list by first block of ranges
+ */
+void
+br_sort(struct block_ranges_t* list);
+
+/**
+ * merge ranges of a sorted list that overlap or start at most glob blocks
+ * after start of the previous range
+ */
+void
+br_compact(struct block_ranges_t* list, size_t glob);
+
+/**
+ * check if block is in a sorted list of ranges that don't overlap
+ */
+int
+br_contains(struct block_ranges_t* list, off_t block);
+
+/**
+ * add block to a sorted list of ranges that don't overlap, keeping it sorted
+ * and merging the block with neighbouring ranges
+ */
+void
+br_insert(struct block_ranges_t* list, off_t block);
+
+/**
+ * return total number of blocks in the list
+ */
+off_t
+br_blocks(struct block_ranges_t* list);
+
+#endif
@@ -30,22 +30,43 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/ioctl.h>
+#include <sys/sysmacros.h>
+#include <sys/mman.h>
+#include <sys/file.h>
+#include <sys/resource.h>
 #include <linux/fs.h>
+#include <linux/fiemap.h>
+#include <linux/fsmap.h>
+#include <ftw.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <err.h>
+#include <aio.h>
 #include <sched.h>
 #include <sys/syscall.h>
+#include <signal.h>
 #include <getopt.h>
 #include <math.h>
 #include <fenv.h>
 #include <string.h>
 #include <assert.h>
 #include <stdint.h>
+#include <limits.h>
+#include <malloc.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
 #include "ioprio.h"
 #include "block_info.h"
+#include "block_list.h"
+#include "json_writer.h"
+#include "metrics.h"
+#include "probes.h"
+#include "timing.h"
+#include "sg_cmds_basic.h"
 #include "sg_cmds_extra.h"
-#define TIMER_TYPE CLOCK_REALTIME
+#include "sg_lib.h"
+#define TIMER_TYPE TIMING_CLOCK
 #ifdef __GNUC__
 #define PURE_FUNCTION  __attribute__ ((pure))
 #else
@@ -61,6 +82,69 @@ const struct version_t {
     const int revision;
 } version = {0, 5, 0};
 
+/** read times of a range of sectors inside a suspect block */
+struct sector_info_t {
+    off_t lba; ///< first sector of the range
+    off_t len; ///< number of sectors in the range
+    struct block_info_t times; ///< read times, in ms
+};
+
+/** read speed statistics of a part of the disk */
+struct speed_bucket_t {
+    long long blocks; ///< number of blocks read
+    double time; ///< sum of read times, in seconds
+    double median; ///< rolling median of block times, in ms
+    long long errors; ///< number of read errors
+};
+
+/// number of parts the disk is split into for speed profile
+#define SPEED_BUCKETS 1024
+
+/// parts of processing of a single block in the full scan
+enum {
+    PROFILE_IO = 0, ///< waiting for the read
+    PROFILE_STAT, ///< reading the clock and disk statistics
+    PROFILE_ANALYSIS, ///< updating block statistics
+    PROFILE_DISPLAY, ///< publishing status
+    PROFILE_PHASES
+};
+
+/// CPU time is measured in one of this many blocks
+#define PROFILE_CPU_EVERY 64
+/// warn when hdck's own time per block is larger than this part of the
+/// fastest block class
+#define PROFILE_WARN_FRACTION 0.05
+
+/** time hdck spends in different parts of processing a block */
+struct self_profile_t {
+    uint64_t ticks[PROFILE_PHASES]; ///< wall time, in timestamp counter ticks
+    double cpu[PROFILE_PHASES]; ///< thread CPU time in sampled blocks, in s
+    long long blocks; ///< number of processed blocks
+    long long cpu_blocks; ///< number of blocks with measured CPU time
+    int phase; ///< part of processing running now
+    int sample_cpu; ///< whether CPU time of current block is measured
+    uint64_t last; ///< timestamp of last phase change
+    double last_cpu; ///< thread CPU time at last phase change
+    double ticks_per_ns; ///< frequency of the timestamp counter
+    double timer_overhead; ///< time needed to read the timing clock, in ns
+};
+
+/// size of huge pages used for sample storage with --mlock
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+/// amount of stack touched in advance with --mlock
+#define STACK_PREFAULT (256 * 1024)
+
+/// number of LBA columns of the finest heatmap level (power of two)
+#define HEATMAP_WIDTH 16384
+/// number of latency rows of the heatmap, the last one counts read errors
+#define HEATMAP_ROWS 64
+/// shortest latency in the heatmap, in ms
+#define HEATMAP_MIN_LATENCY 0.01
+/// number of latency rows per decade
+#define HEATMAP_ROWS_PER_DECADE 10
+/// widest heatmap image written
+#define HEATMAP_IMAGE_WIDTH 2048
+
 /** structure representing program status */
 struct status_t {
     size_t sectors; /**< number of sectors read per sample */
@@ -81,6 +165,49 @@ struct status_t {
     double vslow_lvl;  /**< block read speed considered very slow */
     int sector_times;  /**< how to display individual block times */
     int quick; /**< quick mode */
+    int progressive; /**< read disk with progressively finer stride */
+    int sprt; /**< use sequential probability ratio test for re-reads */
+    /** when the test has to end, zero if there is no deadline */
+    struct timespec deadline;
+    /** time (in seconds) reserved for re-reads when deadline is set */
+    double deadline_reserve;
+    /** whether the test was cut short by the deadline */
+    int deadline_hit;
+    /** measured time (in seconds) needed to re-read single listed block,
+     * including its share of merged ranges, warm-up reads and seeks */
+    double reread_cost;
+    /** direction of the next re-read sweep, 1 from start of disk, -1 from
+     * its end, changed by perform_re_reads() after every pass */
+    int reread_direction;
+    /** name of file to save unfinished ranges to when deadline is reached */
+    char* state_file;
+    int skip_errors; /**< skip ahead after consecutive read errors */
+    /** time (in seconds) after which a read is abandoned, 0 for default */
+    double timeout;
+    /** regions of blocks skipped because of read errors */
+    struct block_ranges_t skipped;
+    /** regions skipped because of read errors that the deadline didn't
+     * leave time to check */
+    struct block_ranges_t unscanned;
+    int expand; /**< probe neighbourhood of slow and unreadable blocks */
+    /** ranges of damaged sectors found by probing around suspect blocks */
+    struct block_list_t* damaged;
+    size_t damaged_len; /**< number of entries in damaged */
+    int zoom; /**< find slow sectors inside slow and unreadable blocks */
+    /** rolling median of block times in every zone (LBA region), NULL when
+     * blocks are judged with global thresholds only */
+    double* zone_median;
+    /** read speed in parts of the disk, NULL when not recorded */
+    struct speed_bucket_t* speed;
+    size_t speed_len; /**< number of entries in speed */
+    /** histogram of LBA (columns) and latency (rows) of reads, NULL when
+     * not recorded */
+    uint32_t* heatmap;
+    size_t heatmap_width; /**< number of columns in heatmap */
+    /** slow and unreadable sectors found by zooming into suspect blocks */
+    struct sector_info_t* zoomed;
+    size_t zoomed_len; /**< number of entries in zoomed */
+    size_t zoomed_alloc; /**< number of allocated entries in zoomed */
     int usb_mode; /**< disk is behind USB bridge */
     int ata_verify; /**< use ATA VERIFY to test disk */
     /*
@@ -122,6 +249,7 @@ struct status_t {
      * run statistics
      */
     long long tot_errors; /**< total number of read errors encountered */
+    long long tot_timeouts; /**< total number of reads that timed out */
     long long tot_vvfast; /**< total number of very very fast reads */
     long long tot_vfast;  /**< total number of very fast reads */
     long long tot_fast;   /**< total number of fast reads */
@@ -132,6 +260,7 @@ struct status_t {
     long double tot_sum;  /**< sum of all valid samples */
     long long tot_samples; /**< number of all samples taken */
     long long errors;     /**< number of blocks with read errors */
+    long long timeouts;   /**< number of reads of blocks that timed out */
     long long vvfast;     /**< number of very very fast blocks */
     long long vfast;      /**< number of very fast blocks */
     long long fast;       /**< number of fast blocks */
@@ -141,6 +270,30 @@ struct status_t {
     long long vvslow;     /**< number of very very slow blocks */
     long long tot_interrupts; /**< total number of read interruptions */
     long long invalid;    /**< number of blocks with useless data */
+    double* loop_times;   /**< duration of every main loop, in seconds */
+    size_t loop_times_len; /**< number of entries in loop_times */
+    double reread_time;   /**< duration of re-reads, in seconds */
+    /** publisher of live metrics, NULL when not exported */
+    struct metrics_t* metrics;
+    int phase; /**< part of the test running, reported in metrics */
+    /** breakdown of hdck's own processing time, NULL when not measured */
+    struct self_profile_t* profile;
+    /** histogram of read times, collected only when metrics are exported */
+    long long latency[METRICS_LATENCY_BINS];
+    /** preallocated storage for samples, NULL when memory isn't locked */
+    double* sample_pool;
+    size_t sample_pool_size; /**< size of sample_pool, in bytes */
+    long long scan_faults; /**< page faults taken during whole disk scans */
+    /** blocks whose samples outgrew preallocated storage during whole disk
+     * scans, see bi_pool_spills */
+    long long scan_spills;
+    /** aligned buffer shared by all re-reads, NULL until first used */
+    char* reread_buffer;
+    char* reread_buffer_free; /**< pointer for freeing reread_buffer */
+    /** stats of blocks in the re-read chunk, reused by following chunks */
+    struct block_info_t* chunk_data;
+    double* chunk_samples; /**< storage for samples of chunk_data */
+    size_t chunk_size; /**< number of blocks chunk_data has room for */
     struct timespec time_end; /**< wall clock end time */
     struct timespec time_start; /**< wall clock end time */
 };
@@ -205,27 +358,103 @@ usage(struct status_t *st)
   printf("-o, --outfile FILE  output file for block level detailed statistics\n");
   printf("-w, --bad-sectors FILE output file for the uncertain sectors\n");
   printf("-r, --read-sectors FILE list of ranges to scan instead of whole disk\n");
+  printf("--fs-extents PATH   scan only blocks used by file system mounted at "
+      "PATH or,\n");
+  printf("                    if PATH is a file, by files listed in it (one per"
+      " line)\n");
   printf("-l, --log FILE      log file to use\n");
   printf("--quick             quick mode\n");
+  printf("--sample NUM        read only a stratified random sample of blocks"
+      " and\n");
+  printf("                    estimate disk condition, NUM is either a "
+      "fraction of the\n");
+  printf("                    disk (0.01 or 1%%) or time to sample for "
+      "(30s, 10m, 1h)\n");
+  printf("--errors-only       look only for unreadable sectors, reading "
+      "the disk at\n");
+  printf("                    full speed, -w gets the list of unreadable "
+      "sectors\n");
+  printf("--skip-errors       after consecutive read errors skip ahead "
+      "exponentially,\n");
+  printf("                    edges of skipped regions are found after the "
+      "scan\n");
+  printf("--timeout TIME      give up on reads that take longer than TIME "
+      "seconds\n");
+  printf("                    (also 5s, 1m), they are reported separately "
+      "from errors\n");
+  printf("--expand            probe neighbours of slow and unreadable blocks "
+      "in smaller\n");
+  printf("                    reads, further out while they are damaged "
+      "too\n");
+  printf("--zoom              re-read slow and unreadable blocks in smaller "
+      "and smaller\n");
+  printf("                    parts to find the exact sectors\n");
+  printf("--progressive       read the disk in passes with progressively "
+      "finer stride,\n");
+  printf("                    so that interim results cover whole disk\n");
   printf("--nodirect          don't use O_DIRECT\n");
   printf("--noflush           don't flush system buffers before reading\n");
   printf("--nosync            don't use O_SYNC\n");
   printf("--noaffinity        don't set CPU affinity to 0th core/CPU\n");
   printf("--nortio            don't change IO priority to real-time\n");
   printf("--nort              don't make the process real-time\n");
+  printf("--mlock             preallocate sample storage and lock all memory, "
+      "so that\n");
+  printf("                    page faults don't slow down the timed reads\n");
   printf("--sector-symbols    print symbols representing read time of each"
                                                        " block\n");
   printf("--sector-times      print time it takes to read each group of"
                                                         " sectors (in µs)\n");
   printf("--min-reads NUM     minimal number of valid reads for a sector\n");
   printf("--max-reads NUM     maximal number of re-reads for a sector\n");
+  printf("--sprt              re-read slow blocks only until sequential "
+      "probability\n");
+  printf("                    ratio test decides if they're healthy or slow\n");
   printf("--max-std-deviation NUM minimal relative standard deviation for "
       "a sector to be\n");
   printf("                    considered valid (ignored)\n");
   printf("--max-sectors NUM   read at most NUM sectors\n");
+  printf("--deadline TIME     finish the test in TIME (30m, 8h), reading the"
+      " disk fewer\n");
+  printf("                    times and re-reading the most uncertain blocks"
+      " first\n");
+  printf("--state FILE        when the deadline is reached, save unfinished "
+      "ranges to\n");
+  printf("                    FILE, to resume the test use it with -r\n");
   printf("--disk-cache NUM    size of the on-board disk cache in MiB (default"
       " 32)\n");
   printf("--disk-rpm NUM      disk RPM (7200 by default)\n");
+  printf("--zones             judge blocks relative to median block time "
+      "in their part\n");
+  printf("                    of the disk, not only with global "
+      "thresholds\n");
+  printf("--speed-profile FILE write read speed and median block time in "
+      "%i parts of\n", SPEED_BUCKETS);
+  printf("                    the disk to FILE, as CSV\n");
+  printf("--heatmap PREFIX    write histogram of read times along the disk "
+      "as image\n");
+  printf("                    (PREFIX.ppm) and zoomable pyramid "
+      "(PREFIX.pyr)\n");
+  printf("--json FILE         write results of the full test to FILE as "
+      "JSON\n");
+  printf("--metrics-file FILE keep live progress and statistics in FILE in "
+      "Prometheus\n");
+  printf("                    text format, for node_exporter textfile "
+      "collector\n");
+  printf("--metrics-socket PATH serve the same metrics on Unix socket PATH\n");
+  printf("--metrics-interval SEC how often to refresh metrics file, 1s by "
+      "default\n");
+  printf("--self-profile      measure time hdck spends on every block "
+      "besides reading it\n");
+  printf("--refresh HZ        how many times a second to redraw the status, "
+      "2 by default,\n");
+  printf("                    0.1 when output is not a terminal\n");
+  printf("--calibrate         measure disk RPM and cache size before the "
+      "test\n");
+  printf("--profiles FILE     reuse calibration of the same disk model and "
+      "firmware\n");
+  printf("                    saved in FILE, new calibrations are added to "
+      "it\n");
   printf("--noverbose         reduce verbosity\n");
   printf("--no-usb            not testing over USB bridge\n");
   printf("--ata-verify        use ATA VERIFY command to reduce bandwidth"
@@ -351,8 +580,8 @@ static int
 _block_compare(const void *a, const void *b)
 {
   off_t off_a, off_b;
-  off_a = ((struct block_list_t*)a)->off;
-  off_b = ((struct block_list_t*)b)->off;
+  off_a = ((struct block_range_t*)a)->off;
+  off_b = ((struct block_range_t*)b)->off;
 
   struct block_info_t *x, *y;
 
@@ -411,11 +640,12 @@ _block_compare(const void *a, const void *b)
 void
 sort_worst_block_list(struct status_t *st,
     struct block_info_t *block_info, size_t block_info_len,
-    struct block_list_t *block_list, size_t block_list_len)
+    struct block_range_t *block_list, size_t block_list_len)
 {
   _block_compare_block_info = block_info;
 
-  qsort(block_list, block_list_len, sizeof(struct block_list_t), _block_compare);
+  qsort(block_list, block_list_len, sizeof(struct block_range_t),
+      _block_compare);
 
   /*
   for (size_t i=0; i<block_list_len; i++)
@@ -454,6 +684,365 @@ time_double(struct timespec ts)
   return ts.tv_sec + ts.tv_nsec * 1.0 / 1E9;
 }
 
+/**
+ * parse time duration with unit suffix (s, m, h or d)
+ *
+ * @return duration in seconds, negative value if the string isn't a duration
+ */
+double
+parse_duration(const char *str)
+{
+  char *end;
+  double val;
+
+  errno = 0;
+  val = strtod(str, &end);
+  if (errno != 0 || end == str || val < 0)
+    return -1.0;
+
+  if (strcmp(end, "s") == 0)
+    return val;
+  else if (strcmp(end, "m") == 0)
+    return val * 60;
+  else if (strcmp(end, "h") == 0)
+    return val * 3600;
+  else if (strcmp(end, "d") == 0)
+    return val * 24 * 3600;
+
+  return -1.0;
+}
+
+/// set by SIGINT or SIGTERM, the test stops early and writes the report
+static volatile sig_atomic_t stop_requested = 0;
+
+/**
+ * ask the test to stop, second signal kills the process as the handler
+ * is installed with SA_RESETHAND
+ */
+static void
+stop_handler(int sig)
+{
+  static const char msg[] = "\nstopping, results will be partial, "
+      "interrupt again to abort\n";
+  ssize_t ret;
+
+  (void)sig;
+  stop_requested = 1;
+  ret = write(STDERR_FILENO, msg, sizeof(msg) - 1);
+  (void)ret;
+}
+
+/**
+ * return number of seconds left until the deadline, HUGE_VAL if there is no
+ * deadline set, 0 if the user asked to stop the test
+ */
+double
+time_left(struct status_t *st)
+{
+  struct timespec now, res;
+
+  if (stop_requested)
+    return 0.0;
+
+  if (st->deadline.tv_sec == 0 && st->deadline.tv_nsec == 0)
+    return HUGE_VAL;
+
+  clock_gettime(TIMER_TYPE, &now);
+
+  if (now.tv_sec > st->deadline.tv_sec ||
+      (now.tv_sec == st->deadline.tv_sec && now.tv_nsec >= st->deadline.tv_nsec))
+    return 0.0;
+
+  diff_time(&res, now, st->deadline);
+
+  return time_double(res);
+}
+
+/// read that didn't finish in time, kept until the kernel completes it
+struct abandoned_read_t {
+    struct aiocb *cb; ///< request, its descriptor is a private duplicate
+    char *buffer; ///< buffer the request reads to
+    struct abandoned_read_t *next;
+};
+
+/// reads given up on after timeout
+struct abandoned_read_t *_abandoned_reads = NULL;
+
+/// state of reads done with timeout
+struct {
+    int fd; ///< duplicate of the device descriptor, -1 if not opened yet
+    struct aiocb *cb; ///< request
+    char *buffer; ///< aligned buffer the request reads to
+    size_t buffer_len; ///< size of buffer
+    /** time (in ns) the last read spent submitting the request, collecting
+     * its result and copying the data, not waiting for the device */
+    int64_t overhead;
+} _timed_read = { -1, NULL, NULL, 0, 0 };
+
+/**
+ * free resources of abandoned reads that finished in the mean time
+ */
+void
+reap_abandoned_reads(void)
+{
+  struct abandoned_read_t **ar = &_abandoned_reads;
+
+  while (*ar != NULL)
+    {
+      struct abandoned_read_t *tmp = *ar;
+
+      if (aio_error(tmp->cb) == EINPROGRESS)
+        {
+          ar = &tmp->next;
+          continue;
+        }
+
+      aio_return(tmp->cb);
+      close(tmp->cb->aio_fildes);
+      free(tmp->cb);
+      free(tmp->buffer);
+      *ar = tmp->next;
+      free(tmp);
+    }
+}
+
+/**
+ * give up on asynchronous read, its descriptor and buffer are released when
+ * it finishes
+ */
+void
+abandon_read(struct aiocb *cb, char *buffer)
+{
+  struct abandoned_read_t *ar;
+
+  if (aio_cancel(cb->aio_fildes, cb) == AIO_CANCELED)
+    {
+      aio_return(cb);
+      close(cb->aio_fildes);
+      free(cb);
+      free(buffer);
+      return;
+    }
+
+  ar = malloc(sizeof(struct abandoned_read_t));
+  if (ar == NULL)
+    err(EXIT_FAILURE, "abandon_read");
+  ar->cb = cb;
+  ar->buffer = buffer;
+  ar->next = _abandoned_reads;
+  _abandoned_reads = ar;
+}
+
+/**
+ * wait for asynchronous request to finish, at most timeout seconds
+ *
+ * @return 0 if the request finished, -1 on timeout
+ */
+int
+aio_wait(struct aiocb *cb, double timeout)
+{
+  const struct aiocb *list[1] = { cb };
+  struct timespec ts;
+  int64_t end = timing_now() + (int64_t)(timeout * 1E9);
+
+  while (aio_error(cb) == EINPROGRESS)
+    {
+      // aio_suspend() interrupted by a signal has to wait only for the rest
+      if (timeout > 0)
+        {
+          int64_t left = end - timing_now();
+
+          if (left <= 0)
+            return -1;
+          ts.tv_sec = left / 1000000000;
+          ts.tv_nsec = left % 1000000000;
+        }
+
+      if (aio_suspend(list, 1, (timeout > 0) ? &ts : NULL) != 0 &&
+          errno == EAGAIN)
+        return -1;
+    }
+
+  return 0;
+}
+
+/**
+ * pread(2) that gives up after st->timeout seconds
+ *
+ * Without timeout the read is done synchronously, otherwise it's done
+ * asynchronously to private buffer (requests that don't finish in time
+ * can't be stopped, they're abandoned)
+ *
+ * @return like pread(2), on timeout -1 with errno set to ETIMEDOUT
+ */
+ssize_t
+pread_timeout(struct status_t *st, int fd, void *buf, size_t count,
+    off_t offset)
+{
+  ssize_t ret;
+  int error;
+  int64_t start, submitted, finished;
+
+  _timed_read.overhead = 0;
+
+  if (st->timeout <= 0)
+    return pread(fd, buf, count, offset);
+
+  start = timing_now();
+
+  reap_abandoned_reads();
+
+  if (_timed_read.fd < 0)
+    {
+      // glibc executes requests for single descriptor one after another,
+      // so abandoned request would block the following ones
+      _timed_read.fd = dup(fd);
+      if (_timed_read.fd < 0)
+        err(EXIT_FAILURE, "pread_timeout: dup");
+      _timed_read.cb = calloc(1, sizeof(struct aiocb));
+      if (_timed_read.cb == NULL)
+        err(EXIT_FAILURE, "pread_timeout");
+    }
+  if (_timed_read.buffer_len < count)
+    {
+      free(_timed_read.buffer);
+      if (posix_memalign((void **)&_timed_read.buffer, pagesize, count) != 0)
+        err(EXIT_FAILURE, "pread_timeout");
+      _timed_read.buffer_len = count;
+    }
+
+  memset(_timed_read.cb, 0, sizeof(struct aiocb));
+  _timed_read.cb->aio_fildes = _timed_read.fd;
+  _timed_read.cb->aio_buf = _timed_read.buffer;
+  _timed_read.cb->aio_nbytes = count;
+  _timed_read.cb->aio_offset = offset;
+  if (aio_read(_timed_read.cb) != 0)
+    return -1;
+
+  submitted = timing_now();
+  if (aio_wait(_timed_read.cb, st->timeout) != 0)
+    {
+      abandon_read(_timed_read.cb, _timed_read.buffer);
+      _timed_read.fd = -1;
+      _timed_read.cb = NULL;
+      _timed_read.buffer = NULL;
+      _timed_read.buffer_len = 0;
+      errno = ETIMEDOUT;
+      return -1;
+    }
+
+  finished = timing_now();
+
+  error = aio_error(_timed_read.cb);
+  ret = aio_return(_timed_read.cb);
+  if (ret >= 0)
+    memcpy(buf, _timed_read.buffer, ret);
+
+  _timed_read.overhead = (submitted - start) + (timing_now() - finished);
+
+  if (ret < 0)
+    {
+      errno = error;
+      return -1;
+    }
+
+  return ret;
+}
+
+/**
+ * return time between two readings of the clock around a read, without the
+ * overhead of the asynchronous read done when timeout is set, in ns
+ */
+static inline int64_t
+read_elapsed(int64_t start, int64_t end)
+{
+  return timing_elapsed(start, end - _timed_read.overhead);
+}
+
+/**
+ * read(2) that gives up after st->timeout seconds, see pread_timeout()
+ */
+ssize_t
+read_timeout(struct status_t *st, int fd, void *buf, size_t count)
+{
+  off_t offset;
+  ssize_t ret;
+
+  if (st->timeout <= 0)
+    return read(fd, buf, count);
+
+  offset = lseek(fd, 0, SEEK_CUR);
+  if (offset < 0)
+    return -1;
+
+  ret = pread_timeout(st, fd, buf, count, offset);
+  if (ret > 0 && lseek(fd, offset + ret, SEEK_SET) < 0)
+    return -1;
+
+  return ret;
+}
+
+/**
+ * verify sectors with ATA VERIFY, returns the same values as read_sectors()
+ */
+static ssize_t
+verify_sectors(struct status_t *st, int fd, off_t lba, size_t sectors)
+{
+  unsigned int info;
+  int res;
+
+  if (st->timeout > 0)
+    res = sg_ll_verify10_timeout(fd, 0, 0, 0, (unsigned int)lba,
+        sectors, NULL, 0, (int)ceil(st->timeout), &info, 1, st->verbosity);
+  else
+    res = sg_ll_verify10(fd, 0, 0, 0, (unsigned int)lba,
+        sectors, NULL, 0, &info, 1, st->verbosity);
+
+  if (res == SG_LIB_CAT_TIMEOUT)
+    {
+      errno = ETIMEDOUT;
+      return -1;
+    }
+  if (res != 0)
+    {
+      errno = EIO;
+      return -1;
+    }
+
+  return sectors * 512;
+}
+
+/**
+ * read sectors from device, or verify them with ATA VERIFY when
+ * st->ata_verify is set
+ *
+ * Reads are done from current position of fd (lba is ignored), verify
+ * doesn't use nor move the position. Read data is discarded.
+ *
+ * @param lba first sector to verify
+ * @param sectors number of sectors
+ * @return number of bytes read (verified), -1 on error with errno set to EIO,
+ * or ETIMEDOUT when the command didn't finish in st->timeout
+ */
+ssize_t
+read_sectors(struct status_t *st, int fd, char *buffer, off_t lba,
+    size_t sectors)
+{
+  ssize_t ret;
+
+  HDCK_PROBE2(read__start, lba, sectors);
+
+  _timed_read.overhead = 0;
+  if (!st->ata_verify)
+    ret = read_timeout(st, fd, buffer, sectors * 512);
+  else
+    ret = verify_sectors(st, fd, lba, sectors);
+
+  HDCK_PROBE3(read__done, lba, sectors, ret);
+
+  return ret;
+}
+
 PURE_FUNCTION
 int
 bitcount(unsigned short int n)
@@ -483,14 +1072,15 @@ update_block_stats(struct status_t *st, struct block_info_t *block_info)
   st->vslow=0;
   st->vvslow=0;
   st->errors=0;
+  st->timeouts=0;
   for (size_t i=0; i< st->number_of_blocks; i++)
     {
       st->errors += bi_get_error(&block_info[i]);
+      st->timeouts += bi_get_timeout(&block_info[i]);
 
+      // not read yet (e.g. in progressive mode or with block lists)
       if (!bi_is_initialised(&block_info[i]))
-        {
-          break;
-        }
+        continue;
 
       if (bi_is_valid(&block_info[i]) == 0)
         {
@@ -592,6 +1182,162 @@ add_block(struct status_t *st, struct block_info_t *block, double new_time)
     st->invalid++;
 }
 
+/// number of regions the disk is split into for zone baselines
+#define ZONE_COUNT 128
+/// relative step of rolling medians
+#define MEDIAN_STEP 0.02
+/**
+ * move rolling median estimate towards the sample
+ *
+ * Every sample moves the estimate by a small step, so it settles where
+ * there are as many samples below as above it
+ */
+static void
+rolling_median_add(double *median, double sample)
+{
+  if (*median == 0.0)
+    *median = sample;
+  else if (sample > *median)
+    *median += *median * MEDIAN_STEP;
+  else if (sample < *median)
+    *median -= *median * MEDIAN_STEP;
+}
+
+/**
+ * return zone (LBA region) of the block
+ */
+static size_t
+block_zone(struct status_t *st, off_t block)
+{
+  return block * ZONE_COUNT / st->number_of_blocks;
+}
+
+/**
+ * update rolling median of block times in zone of the block
+ */
+void
+update_zone_baseline(struct status_t *st, off_t block, double time)
+{
+  if (st->zone_median == NULL)
+    return;
+
+  rolling_median_add(&st->zone_median[block_zone(st, block)], time);
+}
+
+/**
+ * add block read to speed profile
+ *
+ * @param time read time in ms, negative for read errors
+ */
+void
+update_speed_profile(struct status_t *st, off_t block, double time)
+{
+  struct speed_bucket_t *bucket;
+
+  if (st->speed == NULL)
+    return;
+
+  bucket = &st->speed[block * st->speed_len / st->number_of_blocks];
+  if (time < 0)
+    {
+      bucket->errors++;
+      return;
+    }
+  bucket->blocks++;
+  bucket->time += time / 1000;
+  rolling_median_add(&bucket->median, time);
+}
+
+/**
+ * record duration of finished main loop
+ */
+void
+add_loop_time(struct status_t *st, double time)
+{
+  st->loop_times = realloc(st->loop_times,
+      sizeof(double) * (st->loop_times_len + 1));
+  if (st->loop_times == NULL)
+    err(EXIT_FAILURE, "add_loop_time");
+
+  st->loop_times[st->loop_times_len++] = time;
+}
+
+/**
+ * add block read to heatmap
+ *
+ * @param time read time in ms, negative for read errors
+ */
+void
+update_heatmap(struct status_t *st, off_t block, double time)
+{
+  size_t column, row;
+
+  if (st->heatmap == NULL)
+    return;
+
+  column = block * st->heatmap_width / st->number_of_blocks;
+  if (time < 0)
+    row = HEATMAP_ROWS - 1;
+  else if (time <= HEATMAP_MIN_LATENCY)
+    row = 0;
+  else
+    {
+      row = (size_t)(log10(time / HEATMAP_MIN_LATENCY) *
+          HEATMAP_ROWS_PER_DECADE);
+      if (row > HEATMAP_ROWS - 2)
+        row = HEATMAP_ROWS - 2;
+    }
+
+  if (st->heatmap[column * HEATMAP_ROWS + row] < UINT32_MAX)
+    st->heatmap[column * HEATMAP_ROWS + row]++;
+}
+
+/**
+ * write speed profile as CSV
+ */
+void
+write_speed_profile(struct status_t *st, FILE *handle)
+{
+  fprintf(handle, "first_lba,last_lba,blocks,mib_per_s,median_ms,errors\n");
+
+  for (size_t i=0; i < st->speed_len; i++)
+    {
+      struct speed_bucket_t *bucket = &st->speed[i];
+      off_t first = (off_t)(i * st->number_of_blocks / st->speed_len);
+      off_t last = (off_t)((i + 1) * st->number_of_blocks / st->speed_len);
+
+      fprintf(handle, "%lli,%lli,%lli,%.2f,%.3f,%lli\n",
+          (long long)first * st->sectors,
+          (long long)last * st->sectors - 1,
+          bucket->blocks,
+          (bucket->time > 0) ?
+            bucket->blocks * st->sectors / 2048.0 / bucket->time : 0.0,
+          bucket->median,
+          bucket->errors);
+    }
+}
+
+/**
+ * return how much the block thresholds need to be moved for the zone of the
+ * block, that is, the difference between the zone's baseline and the
+ * typical read time the thresholds were set for
+ */
+double
+zone_shift(struct status_t *st, off_t block)
+{
+  double median;
+
+  if (st->zone_median == NULL)
+    return 0.0;
+
+  median = st->zone_median[block_zone(st, block)];
+  if (median == 0.0)
+    return 0.0;
+
+  // see set_block_thresholds()
+  return median - st->vvfast_lvl / 1.5;
+}
+
 void
 add_sample_to_stats(struct status_t *st, double time)
 {
@@ -643,37 +1389,489 @@ add_sample_to_stats(struct status_t *st, double time)
 
   st->tot_sum += time;
   st->tot_samples++;
+
+  if (st->metrics != NULL)
+    st->latency[metrics_latency_bin(time)]++;
 }
 
+/**
+ * fill metrics snapshot with current state of the test
+ */
 void
-make_real_time(void)
+get_metrics_snapshot(struct status_t *st, struct metrics_snapshot_t *snap,
+    int display, off_t block, size_t loop, int pass, int passes,
+    double progress)
 {
-  struct sched_param sp;
-  sp.sched_priority = 31;
-  if (sched_setscheduler(0,SCHED_FIFO,&sp) < 0)
-    err(EXIT_FAILURE, "scheduler");
+  snap->phase = st->phase;
+  snap->display = display;
+  snap->loop = loop;
+  snap->loops = st->min_reads;
+  snap->pass = pass;
+  snap->passes = passes;
+  snap->lba = (long long)block * st->sectors;
+  snap->disk_sectors = (long long)st->number_of_blocks * st->sectors;
+  snap->progress = progress;
+  snap->bytes_read = st->tot_samples * st->sectors * 512;
+  snap->thresholds[0] = st->vvfast_lvl;
+  snap->thresholds[1] = st->vfast_lvl;
+  snap->thresholds[2] = st->fast_lvl;
+  snap->thresholds[3] = st->normal_lvl;
+  snap->thresholds[4] = st->slow_lvl;
+  snap->thresholds[5] = st->vslow_lvl;
+  snap->reads[0] = st->tot_vvfast;
+  snap->reads[1] = st->tot_vfast;
+  snap->reads[2] = st->tot_fast;
+  snap->reads[3] = st->tot_normal;
+  snap->reads[4] = st->tot_slow;
+  snap->reads[5] = st->tot_vslow;
+  snap->reads[6] = st->tot_vvslow;
+  snap->blocks[0] = st->vvfast;
+  snap->blocks[1] = st->vfast;
+  snap->blocks[2] = st->fast;
+  snap->blocks[3] = st->normal;
+  snap->blocks[4] = st->slow;
+  snap->blocks[5] = st->vslow;
+  snap->blocks[6] = st->vvslow;
+  snap->error_blocks = st->errors;
+  snap->timeout_blocks = st->timeouts;
+  snap->errors = st->tot_errors;
+  snap->timeouts = st->tot_timeouts;
+  snap->interrupts = st->tot_interrupts;
+  snap->invalid = st->invalid;
+  snap->latency_sum = st->tot_sum;
+  memcpy(snap->latency, st->latency, sizeof(st->latency));
 }
 
+/**
+ * make current state of the test available to the metrics thread and the
+ * status display
+ *
+ * @param display kind of status display
+ * @param block block read most recently
+ * @param loop number of current main loop, counted from 1
+ * @param pass pass of progressive scan, counted from 1, 0 if none
+ * @param passes number of passes of progressive scan
+ * @param progress completed part of current phase, from 0 to 1
+ */
 void
-set_affinity(void)
+publish_metrics(struct status_t *st, int display, off_t block, size_t loop,
+    int pass, int passes, double progress)
 {
-  cpu_set_t cpu_set;
-  CPU_ZERO(&cpu_set); // zero the CPU set
-  CPU_SET(0, &cpu_set); // add first cpu to the set
-  if (sched_setaffinity(0,sizeof(cpu_set_t), &cpu_set) <0)
-    err(EXIT_FAILURE, "affinity");
+  struct metrics_snapshot_t snap;
+
+  if (st->metrics == NULL)
+    return;
+
+  get_metrics_snapshot(st, &snap, display, block, loop, pass, passes,
+      progress);
+  metrics_publish(st->metrics, &snap);
 }
 
+/**
+ * switch to next phase of the test
+ *
+ * Status display is cleared, so that the caller can write to terminal
+ * after this returns.
+ */
 void
-set_rt_ioprio(void)
+set_metrics_phase(struct status_t *st, int phase)
 {
-  if (ioprio_set(IOPRIO_WHO_PROCESS,
+  struct metrics_snapshot_t snap;
+
+  st->phase = phase;
+  if (st->metrics == NULL)
+    return;
+
+  get_metrics_snapshot(st, &snap, METRICS_DISPLAY_NONE, 0, 0, 0, 0, 0);
+  metrics_set(st->metrics, &snap);
+}
+
+/**
+ * format time in seconds as hours, minutes and seconds
+ */
+static const char *
+format_hms(char *buf, size_t len, double time)
+{
+  long long t;
+
+  if (!isfinite(time))
+    return "--:--:--";
+
+  t = (long long)time;
+  snprintf(buf, len, "%02lli:%02lli:%02lli", t/3600, t/60%60, t%60);
+  return buf;
+}
+
+/**
+ * print statistics of reads and blocks in every speed class
+ */
+static void
+render_class_table(const struct metrics_snapshot_t *snap)
+{
+  printf("         Samples:             Blocks (9th decile):%s\n",
+      CLEAR_LINE_END);
+  for (int i=0; i < METRICS_CLASSES - 1; i++)
+    printf("<%4.1fms: %20lli %20lli%s\n", snap->thresholds[i],
+        snap->reads[i], snap->blocks[i], CLEAR_LINE_END);
+  printf(">%4.1fms: %20lli %20lli%s\n", snap->thresholds[METRICS_CLASSES - 2],
+      snap->reads[METRICS_CLASSES - 1], snap->blocks[METRICS_CLASSES - 1],
+      CLEAR_LINE_END);
+  printf("ERR    : %20lli %20lli%s\n", snap->errors, snap->error_blocks,
+      CLEAR_LINE_END);
+  printf("Intrrpt: %20lli %20lli%s\n", snap->interrupts, snap->invalid,
+      CLEAR_LINE_END);
+  printf("TIMEOUT: %20lli %20lli%s\n", snap->timeouts, snap->timeout_blocks,
+      CLEAR_LINE_END);
+}
+
+/**
+ * draw status of the test on terminal, in place of the previous one
+ */
+void
+render_status(const struct metrics_snapshot_t *snap,
+    const struct metrics_progress_t *progress)
+{
+  char elapsed[32], eta[32];
+
+  format_hms(elapsed, sizeof(elapsed), progress->elapsed);
+  format_hms(eta, sizeof(eta), progress->elapsed + progress->eta);
+
+  if (snap->display == METRICS_DISPLAY_LIST)
+    {
+      printf("reread %.2f%% done in %s, expected time:%s%s\n",
+          snap->progress * 100, elapsed, eta, CLEAR_LINE_END);
+      render_class_table(snap);
+      printf("\r%s", cursor_up(12));
+      return;
+    }
+
+  // progress of the current loop
+  double percent = snap->progress * snap->loops - (snap->loop - 1);
+
+  printf("hdck status:%s\n", CLEAR_LINE_END);
+  printf("============%s\n", CLEAR_LINE_END);
+  if (snap->pass != 0)
+    printf("Loop:          %lli of %lli, pass %i of %i%s\n", snap->loop,
+        snap->loops, snap->pass, snap->passes, CLEAR_LINE_END);
+  else
+    printf("Loop:          %lli of %lli%s\n", snap->loop, snap->loops,
+        CLEAR_LINE_END);
+  printf("Progress:      %.2f%%, %.2f%% total%s\n", percent * 100,
+      snap->progress * 100, CLEAR_LINE_END);
+  printf("Read:          %lli sectors of %lli%s\n", snap->lba,
+      snap->disk_sectors, CLEAR_LINE_END);
+  printf("Speed:         %.3fMiB/s, average: %.3fMiB/s%s\n", progress->speed,
+      progress->average_speed, CLEAR_LINE_END);
+  printf("Elapsed time:  %s%s\n", elapsed, CLEAR_LINE_END);
+  printf("Expected time: %s%s\n", eta, CLEAR_LINE_END);
+  render_class_table(snap);
+  printf("\r%s", cursor_up(19));
+}
+
+/**
+ * print status of the test as single line, for output that isn't a terminal
+ */
+void
+render_status_line(const struct metrics_snapshot_t *snap,
+    const struct metrics_progress_t *progress)
+{
+  char elapsed[32], eta[32];
+
+  format_hms(elapsed, sizeof(elapsed), progress->elapsed);
+  format_hms(eta, sizeof(eta), progress->eta);
+
+  if (snap->display == METRICS_DISPLAY_LIST)
+    printf("reread: %.2f%%", snap->progress * 100);
+  else
+    printf("scan: loop %lli of %lli, %.2f%%, LBA %lli", snap->loop,
+        snap->loops, snap->progress * 100, snap->lba);
+  printf(", %.3fMiB/s, elapsed %s, left %s, errors %lli, timeouts %lli, "
+      "interrupted %lli\n", progress->speed, elapsed, eta, snap->errors,
+      snap->timeouts, snap->interrupts);
+}
+
+/**
+ * publish final state of the test and stop the metrics thread
+ */
+void
+stop_metrics(struct status_t *st)
+{
+  struct metrics_snapshot_t snap;
+
+  if (st->metrics == NULL)
+    return;
+
+  st->phase = METRICS_DONE;
+  get_metrics_snapshot(st, &snap, METRICS_DISPLAY_NONE, st->number_of_blocks,
+      0, 0, 0, 1.0);
+  metrics_stop(st->metrics, &snap);
+  st->metrics = NULL;
+}
+
+/**
+ * read the timestamp counter, or monotonic clock in ns where there is none
+ */
+static inline uint64_t
+read_tsc(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return timing_now();
+#endif
+}
+
+/**
+ * return CPU time used by the calling thread, in seconds
+ */
+static double
+thread_cpu_time(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return time_double(ts);
+}
+
+/**
+ * calibrate the timestamp counter against the timing clock
+ */
+void
+init_self_profile(struct self_profile_t *prof)
+{
+  struct timespec pause = { 0, 20000000 };
+  int64_t start, end;
+  uint64_t tsc_start, tsc_end;
+
+  memset(prof, 0, sizeof(struct self_profile_t));
+  prof->phase = PROFILE_ANALYSIS;
+
+  start = timing_now();
+  tsc_start = read_tsc();
+  nanosleep(&pause, NULL);
+  end = timing_now();
+  tsc_end = read_tsc();
+  prof->ticks_per_ns = (tsc_end - tsc_start) / (double)(end - start);
+
+  prof->timer_overhead = timing_overhead;
+}
+
+/**
+ * account time spent since last call to the part of processing that was
+ * running and switch to the next one
+ */
+static inline void
+profile_switch(struct status_t *st, int phase)
+{
+  struct self_profile_t *prof = st->profile;
+  uint64_t now;
+
+  if (prof == NULL)
+    return;
+
+  now = read_tsc();
+  prof->ticks[prof->phase] += now - prof->last;
+  prof->last = now;
+  if (prof->sample_cpu)
+    {
+      double cpu = thread_cpu_time();
+      prof->cpu[prof->phase] += cpu - prof->last_cpu;
+      prof->last_cpu = cpu;
+    }
+  prof->phase = phase;
+}
+
+/**
+ * start measuring processing of blocks
+ */
+static void
+profile_start(struct status_t *st)
+{
+  if (st->profile == NULL)
+    return;
+
+  st->profile->phase = PROFILE_ANALYSIS;
+  st->profile->last = read_tsc();
+}
+
+/**
+ * mark end of processing of single block
+ */
+static inline void
+profile_block_done(struct status_t *st)
+{
+  struct self_profile_t *prof = st->profile;
+
+  if (prof == NULL)
+    return;
+
+  prof->blocks++;
+  // reading thread CPU time is a system call, do it only for some blocks
+  prof->sample_cpu = (prof->blocks % PROFILE_CPU_EVERY == 0);
+  if (prof->sample_cpu)
+    {
+      prof->last_cpu = thread_cpu_time();
+      prof->cpu_blocks++;
+    }
+}
+
+/**
+ * print average time spent in parts of processing of a block
+ */
+void
+print_self_profile(struct status_t *st, FILE *out)
+{
+  struct self_profile_t *prof = st->profile;
+  static const char *names[PROFILE_PHASES] = {
+      "I/O wait", "stat probe", "analysis", "display"
+  };
+  double total = 0, wall[PROFILE_PHASES], overhead;
+
+  if (prof->blocks == 0)
+    return;
+
+  for (int i=0; i < PROFILE_PHASES; i++)
+    {
+      wall[i] = prof->ticks[i] / prof->ticks_per_ns / 1000 / prof->blocks;
+      total += wall[i];
+    }
+
+  fprintf(out, "time spent per block (in µs):\n");
+  fprintf(out, "%-12s %10s %7s %10s\n", "", "wall", "share", "CPU");
+  for (int i=0; i < PROFILE_PHASES; i++)
+    {
+      fprintf(out, "%-12s %10.2f %6.2f%% ", names[i], wall[i],
+          (total > 0) ? wall[i] / total * 100 : 0.0);
+      if (prof->cpu_blocks > 0)
+        fprintf(out, "%10.2f\n", prof->cpu[i] * 1E6 / prof->cpu_blocks);
+      else
+        fprintf(out, "%10s\n", "-");
+    }
+  fprintf(out, "clock read: %.0fns, measured blocks: %lli\n",
+      prof->timer_overhead, prof->blocks);
+
+  // everything but the read itself ends up in the measured block time
+  overhead = (total - wall[PROFILE_IO]) / 1000;
+  fprintf(out, "hdck overhead in block time: %.4fms (%.2f%% of %.2fms)\n",
+      overhead, overhead / st->vvfast_lvl * 100, st->vvfast_lvl);
+  if (overhead > st->vvfast_lvl * PROFILE_WARN_FRACTION)
+    fprintf(out, "Warning: hdck overhead is larger than %.0f%% of the "
+        "fastest block class, block times are not accurate\n",
+        PROFILE_WARN_FRACTION * 100);
+}
+
+void
+make_real_time(void)
+{
+  struct sched_param sp;
+  sp.sched_priority = 31;
+  if (sched_setscheduler(0,SCHED_FIFO,&sp) < 0)
+    err(EXIT_FAILURE, "scheduler");
+}
+
+void
+set_affinity(void)
+{
+  cpu_set_t cpu_set;
+  CPU_ZERO(&cpu_set); // zero the CPU set
+  CPU_SET(0, &cpu_set); // add first cpu to the set
+  if (sched_setaffinity(0,sizeof(cpu_set_t), &cpu_set) <0)
+    err(EXIT_FAILURE, "affinity");
+}
+
+void
+set_rt_ioprio(void)
+{
+  if (ioprio_set(IOPRIO_WHO_PROCESS,
                0,
                IOPRIO_PRIO_VALUE(IOPRIO_CLASS_RT, 0)
       ) != 0)
   err(EXIT_FAILURE, "ioprio: can't make process IO class real-time");
 }
 
+/**
+ * preallocate storage for samples of all blocks and lock all memory of the
+ * process, so that reads aren't timed together with page faults
+ */
+void
+lock_memory(struct status_t *st, struct block_info_t *block_info)
+{
+  size_t reserve = (st->min_reads > 0) ? st->min_reads : 1;
+  size_t len = st->number_of_blocks * reserve * sizeof(double);
+  volatile char stack[STACK_PREFAULT];
+  const char *pages = "huge";
+  double *pool;
+
+  // memory returned to the system would fault again when reused
+  mallopt(M_TRIM_THRESHOLD, -1);
+  mallopt(M_MMAP_MAX, 0);
+
+  len = (len + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+  pool = mmap(NULL, len, PROT_READ | PROT_WRITE,
+      MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  if (pool == MAP_FAILED)
+    {
+      // no huge pages reserved, try transparent ones
+      pool = mmap(NULL, len, PROT_READ | PROT_WRITE,
+          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (pool == MAP_FAILED)
+        err(EXIT_FAILURE, "mmap: sample storage");
+      if (madvise(pool, len, MADV_HUGEPAGE) == 0)
+        pages = "transparent huge";
+      else
+        pages = "normal";
+    }
+
+  // no block was read yet, every one gets room for samples of min_reads
+  // loops of the scan
+  for (size_t i=0; i < st->number_of_blocks; i++)
+    bi_attach(&block_info[i], pool + i * reserve, reserve);
+
+  st->sample_pool = pool;
+  st->sample_pool_size = len;
+
+  if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+    err(EXIT_FAILURE, "mlockall");
+
+  // locking doesn't populate stack that wasn't used yet
+  memset((char *)stack, 0, sizeof(stack));
+
+  if (st->verbosity > 2)
+    printf("locked memory, %zi MiB of %s pages preallocated for samples\n",
+        len / 1024 / 1024, pages);
+  if (st->flog != NULL)
+    fprintf(st->flog, "Locked memory, %zi MiB of %s pages preallocated for "
+        "samples\n", len / 1024 / 1024, pages);
+}
+
+/**
+ * release memory locked by lock_memory()
+ */
+void
+unlock_memory(struct status_t *st)
+{
+  if (st->sample_pool == NULL)
+    return;
+
+  munlockall();
+  munmap(st->sample_pool, st->sample_pool_size);
+  st->sample_pool = NULL;
+}
+
+/**
+ * return number of page faults taken by the calling thread
+ */
+static long long
+page_faults(void)
+{
+  struct rusage usage;
+
+  if (getrusage(RUSAGE_THREAD, &usage) != 0)
+    return 0;
+
+  return usage.ru_minflt + usage.ru_majflt;
+}
+
 
 /// get file size
 off_t
@@ -772,15 +1970,11 @@ read_link(char* link)
 }
 
 void
-print_block_list(struct block_list_t* block_list)
+print_block_list(struct block_ranges_t* block_list)
 {
-  size_t i = 0;
-
-  while (!(block_list[i].off == 0 && block_list[i].len == 0))
-    {
-      printf("%zi: %lli %lli\n", i, (long long)block_list[i].off, (long long)block_list[i].len);
-      i++;
-    }
+  for (size_t i=0; i < block_list->len; i++)
+    printf("%zi: %lli %lli\n", i, (long long)block_list->ranges[i].off,
+        (long long)block_list->ranges[i].len);
 }
 
 char*
@@ -902,37 +2096,90 @@ get_read_writes(char* filepath,
   return 0;
 }
 
+/**
+ * return aligned buffer for reading a single block, shared by all re-reads
+ */
+static char*
+get_reread_buffer(struct status_t *st)
+{
+  if (st->reread_buffer == NULL)
+    {
+      st->reread_buffer_free = malloc(st->sectors*512+pagesize);
+      if (st->reread_buffer_free == NULL)
+        err(EXIT_FAILURE, "get_reread_buffer");
+      st->reread_buffer = ptr_align(st->reread_buffer_free, pagesize);
+    }
+
+  return st->reread_buffer;
+}
+
+/**
+ * free memory kept for re-reads
+ */
+void
+free_chunk_data(struct status_t *st)
+{
+  for (size_t i=0; i < st->chunk_size; i++)
+    bi_clear(&st->chunk_data[i]);
+  free(st->chunk_data);
+  free(st->chunk_samples);
+  st->chunk_data = NULL;
+  st->chunk_samples = NULL;
+  st->chunk_size = 0;
+}
+
+/**
+ * return empty stats for a chunk of len blocks, every block has room for
+ * one sample; the memory is reused by following chunks
+ */
+static struct block_info_t*
+get_chunk_data(struct status_t *st, size_t len)
+{
+  if (len > st->chunk_size)
+    {
+      size_t size = (len > st->chunk_size * 2) ? len : st->chunk_size * 2;
+
+      free_chunk_data(st);
+      st->chunk_data = calloc(size, sizeof(struct block_info_t));
+      st->chunk_samples = malloc(size * sizeof(double));
+      if (st->chunk_data == NULL || st->chunk_samples == NULL)
+        err(EXIT_FAILURE, "get_chunk_data: len=%zi", len);
+      st->chunk_size = size;
+    }
+
+  for (size_t i=0; i < len; i++)
+    {
+      bi_clear(&st->chunk_data[i]);
+      bi_init(&st->chunk_data[i]);
+      bi_attach(&st->chunk_data[i], &st->chunk_samples[i], 1);
+    }
+
+  return st->chunk_data;
+}
+
 /**
  * reads only the blocks between offset and offset+len
+ *
+ * @return stats of read blocks, valid until the next call, NULL if the
+ * reads were interrupted
  */
 struct block_info_t*
 read_blocks(struct status_t *st, int fd, char* stat_path, off_t offset, off_t len)
 {
-  struct timespec time_start; ///< start of read
-  struct timespec time_end; ///< end of read
-  struct timespec res; ///< temporary result
+  int64_t time_start; ///< start of read, in ns
+  int64_t time_end; ///< end of read, in ns
   long long read_start = 0, read_sectors_s = 0, write_start = 0,
             read_end = 0, read_sectors_e = 0, write_end = 0;
   struct block_info_t* block_info;
   int bad_sectors = 0;
   char* buffer;
-  char* buffer_free;
   off_t nread;
   off_t no_blocks = 0;
-  unsigned int info;
-  int int_res = 0;
 
   assert(len>0);
 
-  block_info = calloc(sizeof(struct block_info_t), len);
-  if (block_info == NULL)
-    err(EXIT_FAILURE, "read_blocks1: len=%lli", (long long)len);
-
-  buffer = malloc(st->sectors*512+pagesize);
-  if (buffer == NULL)
-    err(EXIT_FAILURE, "read_blocks2");
-  buffer_free = buffer;
-  buffer = ptr_align(buffer, pagesize);
+  block_info = get_chunk_data(st, len);
+  buffer = get_reread_buffer(st);
 
   if (stat_path != NULL)
     get_read_writes(stat_path, &read_start, &read_sectors_s, &write_start);
@@ -955,28 +2202,23 @@ read_blocks(struct status_t *st, int fd, char* stat_path, off_t offset, off_t le
   for (size_t i=0; i < disk_cache; i++)
     {
 
-      if (!st->ata_verify)
-        nread = read(fd, buffer, st->sectors*512);
-      else
-        {
-          int_res = sg_ll_verify10(fd, 0, 0, 0,
-              (unsigned int)beggining_pos+i*st->sectors,
-              st->sectors, NULL, 0, &info, 1, st->verbosity);
-          if (int_res != 0)
-            {
-              errno = EIO;
-              nread = -1;
-            }
-          else
-            nread = st->sectors*512;
-        }
+      nread = read_sectors(st, fd, buffer, beggining_pos+i*st->sectors,
+          st->sectors);
 
       if (nread < 0)
         {
-          fprintf(stderr, "E");
           bad_sectors = 1;
 
-          st->tot_errors++;
+          if (errno == ETIMEDOUT)
+            {
+              fprintf(stderr, "T");
+              st->tot_timeouts++;
+            }
+          else
+            {
+              fprintf(stderr, "E");
+              st->tot_errors++;
+            }
 
           if (st->bad_sector_warning)
             {
@@ -998,28 +2240,23 @@ read_blocks(struct status_t *st, int fd, char* stat_path, off_t offset, off_t le
     if ( lseek(fd, (offset-1>=0)?(offset-1)*st->sectors*512:0, SEEK_SET) < 0)
       goto interrupted;
 
-  if (!st->ata_verify)
-    nread = read(fd, buffer, st->sectors*512);
-  else
-    {
-      int_res = sg_ll_verify10(fd, 0, 0, 0, (unsigned int)(offset-1>=0)?
-          (offset-1)*st->sectors:0,
-          st->sectors, NULL, 0, &info, 1, st->verbosity);
-      if (int_res != 0)
-        {
-          errno = EIO;
-          nread = -1;
-        }
-      else
-        nread = st->sectors*512;
-    }
+  nread = read_sectors(st, fd, buffer,
+      (offset-1>=0) ? (offset-1)*st->sectors : 0, st->sectors);
 
   if (nread < 0)
     {
-      fprintf(stderr, "E");
       bad_sectors = 1;
 
-      st->tot_errors++;
+      if (errno == ETIMEDOUT)
+        {
+          fprintf(stderr, "T");
+          st->tot_timeouts++;
+        }
+      else
+        {
+          fprintf(stderr, "E");
+          st->tot_errors++;
+        }
 
       if (st->bad_sector_warning)
         {
@@ -1049,43 +2286,36 @@ read_blocks(struct status_t *st, int fd, char* stat_path, off_t offset, off_t le
     }
 
   // start reading main block
-  clock_gettime(TIMER_TYPE, &time_end);
+  time_end = timing_now();
 
   while (no_blocks < len)
     {
-      time_start.tv_sec = time_end.tv_sec;
-      time_start.tv_nsec = time_end.tv_nsec;
+      time_start = time_end;
 
-      if (!st->ata_verify)
-        nread = read(fd, buffer, st->sectors*512);
-      else
-        {
-          int_res = sg_ll_verify10(fd, 0, 0, 0,
-              (unsigned int)offset*st->sectors+no_blocks*st->sectors,
-              st->sectors, NULL, 0, &info, 1, st->verbosity);
-          if (int_res != 0)
-            {
-              errno = EIO;
-              nread = -1;
-            }
-          else
-            nread = st->sectors*512;
-        }
+      nread = read_sectors(st, fd, buffer,
+          (offset+no_blocks)*st->sectors, st->sectors);
 
-      clock_gettime(TIMER_TYPE, &time_end);
+      time_end = timing_now();
 
       if (nread < 0)
         {
-          if (errno != EIO)
+          if (errno != EIO && errno != ETIMEDOUT)
             err(EXIT_FAILURE, "read_blocks3");
 
-          write(2, "E", 1);
-
-          st->tot_errors++;
-
           // make sure the error is saved and reported later
           bi_make_valid(&block_info[no_blocks]);
-          bi_add_error(&block_info[no_blocks]);
+          if (errno == ETIMEDOUT)
+            {
+              write(2, "T", 1);
+              st->tot_timeouts++;
+              bi_add_timeout(&block_info[no_blocks]);
+            }
+          else
+            {
+              write(2, "E", 1);
+              st->tot_errors++;
+              bi_add_error(&block_info[no_blocks]);
+            }
           bad_sectors = 1;
 
           if (st->bad_sector_warning)
@@ -1112,47 +2342,18 @@ read_blocks(struct status_t *st, int fd, char* stat_path, off_t offset, off_t le
         {
           bi_make_valid(&block_info[no_blocks]);
 
-          diff_time(&res, time_start, time_end);
-          times_time(&res, 1000); // block_info is in ms, not ns
-
-          bi_add_time(&block_info[no_blocks], time_double(res));
-
+          bi_add_time(&block_info[no_blocks],
+              timing_ms(read_elapsed(time_start, time_end)));
         }
       no_blocks++;
     }
 
   // read additional two blocks to exclude the probability that there were
   // unfinished reads or writes in the mean time while the main was run
-  if (!st->ata_verify)
-    nread = read(fd, buffer, st->sectors*512);
-  else
-    {
-      int_res = sg_ll_verify10(fd, 0, 0, 0,
-          (unsigned int)st->sectors*(offset+no_blocks+1),
-          st->sectors, NULL, 0, &info, 1, st->verbosity);
-      if (int_res != 0)
-        {
-          errno = EIO;
-          nread = -1;
-        }
-      else
-        nread = st->sectors*512;
-    }
-  if (!st->ata_verify)
-    nread = read(fd, buffer, st->sectors*512);
-  else
-    {
-      int_res = sg_ll_verify10(fd, 0, 0, 0,
-          (unsigned int)st->sectors*(offset+no_blocks+2),
-          st->sectors, NULL, 0, &info, 1, st->verbosity);
-      if (int_res != 0)
-        {
-          errno = EIO;
-          nread = -1;
-        }
-      else
-        nread = st->sectors*512;
-    }
+  nread = read_sectors(st, fd, buffer, st->sectors*(offset+no_blocks+1),
+      st->sectors);
+  nread = read_sectors(st, fd, buffer, st->sectors*(offset+no_blocks+2),
+      st->sectors);
 
   if (stat_path != NULL)
     get_read_writes(stat_path, &read_end, &read_sectors_e, &write_end);
@@ -1178,6 +2379,8 @@ read_blocks(struct status_t *st, int fd, char* stat_path, off_t offset, off_t le
       && bad_sectors == 0
      )
     {
+      HDCK_PROBE3(interference, offset, read_end - read_start,
+          write_end - write_start);
       goto interrupted;
     }
 
@@ -1185,60 +2388,180 @@ read_blocks(struct status_t *st, int fd, char* stat_path, off_t offset, off_t le
     for(size_t i=0; i < len; i++)
       bi_make_invalid(&block_info[i]);
 
-  free(buffer_free);
   return(block_info);
 
 interrupted:
-  free(buffer_free);
-  for(size_t i=0; i < len; i++)
-    bi_clear(&block_info[i]);
-  free(block_info);
   return NULL;
 }
 
+/// typical read of a block takes about a fifth of rotational delay
+/// (value arrived at experimentally, by reading blocks few thousand times)
+#define BLOCK_READS_PER_REVOLUTION 5.13
+
 /**
- * @param block_list list to compact
- * @param glob globbing parameter -- how far can blocks be to be bound together
+ * number of blocks read around every range by read_blocks(), besides the
+ * range itself
+ *
+ * The range is preceded by warm-up reads (1 block, 16 through USB bridges,
+ * for meaningful results) and the one excluding seek time, and followed by
+ * two trailing reads.
  */
-struct block_list_t*
-compact_block_list(struct block_list_t* block_list, size_t glob)
+static inline off_t
+reread_overhead(struct status_t *st)
+{
+  return 1 + 15 * st->usb_mode + 1 + 2;
+}
+
+/**
+ * number of blocks it's cheaper to read through than to skip
+ *
+ * Reading through a gap costs a block read per block of the gap, skipping
+ * it starts a new range, which costs a seek and the reads of
+ * reread_overhead(). Ranges are taken in order along the disk, so the seek
+ * to the next one is short and costs mostly the wait for the sector to come
+ * under the head, half a revolution on average.
+ */
+static off_t
+reread_merge_gap(struct status_t *st)
+{
+  double block_time = st->rotational_delay / BLOCK_READS_PER_REVOLUTION;
+  double seek = st->rotational_delay / 2;
+
+  return (off_t)((seek + reread_overhead(st) * block_time) / block_time);
+}
+
+/**
+ * get next range to read from sorted block list
+ *
+ * Entries are taken from the beginning of the list when direction is
+ * positive and from its end otherwise, neighbouring entries are merged
+ * while the gap between them is at most gap blocks and the range doesn't
+ * grow over max_len (single entries longer than max_len are returned whole).
+ *
+ * @param list list sorted by offset
+ * @param pos number of entries already used, updated
+ * @param direction direction of the sweep
+ * @param max_len maximal length of merged range
+ * @param gap maximal number of blocks to read between entries
+ * @param ret returned range
+ * @return 0 if the list is exhausted, 1 otherwise
+ */
+static int
+next_block_range(struct block_ranges_t* list, size_t *pos, int direction,
+    size_t max_len, off_t gap, struct block_range_t* ret)
 {
-  struct block_list_t* ret = NULL;
-  size_t block_list_len = 0;
-  size_t ret_len = 0;
+  struct block_range_t *block_list = list->ranges;
+  size_t list_len = list->len;
+  off_t start, end;
+  size_t i;
 
-  while (!(block_list[block_list_len].off == 0 &&
-           block_list[block_list_len].len == 0))
-    block_list_len++;
+  if (*pos >= list_len)
+    return 0;
 
-  ret = calloc(sizeof(struct block_list_t), block_list_len+1);
-  if (ret == NULL)
-    err(EXIT_FAILURE, "compact_block_list");
+  i = (direction > 0) ? *pos : list_len - 1 - *pos;
+  start = block_list[i].off;
+  end = block_list[i].off + block_list[i].len;
+  (*pos)++;
 
-  // compact the list
-  ret[0].off = block_list[0].off;
-  ret[0].len = block_list[0].len;
-  ret_len = 1;
-  for (size_t i=1; i<block_list_len; i++)
+  while (*pos < list_len)
     {
-      // check if the block isn't contained in the previous one
-      if (block_list[i].off < ret[ret_len-1].off + ret[ret_len-1].len)
-        continue;
+      off_t new_start = start, new_end = end;
 
-      // check if we can extend the last block to contain current one
-      if (block_list[i].off <= ret[ret_len-1].off + glob)
-        {
-          ret[ret_len-1].len = block_list[i].off + block_list[i].len
-              - ret[ret_len-1].off;
-          continue;
-        }
+      i = (direction > 0) ? *pos : list_len - 1 - *pos;
 
-      ret[ret_len].off = block_list[i].off;
-      ret[ret_len].len = block_list[i].len;
-      ret_len++;
+      if (direction > 0 && block_list[i].off > end + gap)
+        break;
+      if (direction <= 0 &&
+          block_list[i].off + block_list[i].len + gap < start)
+        break;
+
+      if (block_list[i].off < new_start)
+        new_start = block_list[i].off;
+      if (block_list[i].off + block_list[i].len > new_end)
+        new_end = block_list[i].off + block_list[i].len;
+
+      if (new_end - new_start > (off_t)max_len &&
+          (new_start != start || new_end != end))
+        break;
+
+      start = new_start;
+      end = new_end;
+      (*pos)++;
     }
 
-  return ret;
+  ret->off = start;
+  ret->len = end - start;
+
+  return 1;
+}
+
+/**
+ * estimate number of blocks read while processing rest of the list
+ */
+static off_t
+remaining_range_blocks(struct status_t *st, struct block_ranges_t* block_list,
+    size_t pos, int direction, size_t max_len, off_t gap)
+{
+  struct block_range_t range;
+  off_t total = 0;
+
+  while (next_block_range(block_list, &pos, direction, max_len, gap,
+        &range))
+    total += range.len + reread_overhead(st);
+
+  return total;
+}
+
+/// decisions of the sequential probability ratio test
+enum {
+    SPRT_CONTINUE = 0, /**< more samples are needed */
+    SPRT_HEALTHY, /**< block reads without re-reads */
+    SPRT_SLOW /**< block consistently needs re-reads */
+};
+
+/**
+ * decide whether the block is healthy or slow using Wald's sequential
+ * probability ratio test
+ *
+ * Samples slower than fast_lvl (reads that needed more than a single re-read)
+ * are treated as failures in Bernoulli trials. fast_lvl is the threshold
+ * already moved for the zone of the block, see zone_shift(). Null hypothesis is that the
+ * failure probability is at most 5%, the alternative that it's at least 30%,
+ * both errors are bounded at 5%.
+ */
+int
+sprt_decide(struct status_t *st, struct block_info_t *block_info,
+    double fast_lvl)
+{
+  const double p0 = 0.05; // healthy block failure probability
+  const double p1 = 0.30; // slow block failure probability
+  const double alpha = 0.05; // probability of calling healthy block slow
+  const double beta = 0.05; // probability of calling slow block healthy
+  double llr = 0.0;
+  double *times;
+  size_t n;
+
+  times = bi_get_times(block_info);
+  n = bi_num_samples(block_info);
+
+  for (size_t i=0; i < n; i++)
+    {
+      if (times[i] >= fast_lvl)
+        llr += log(p1 / p0);
+      else
+        llr += log((1 - p1) / (1 - p0));
+    }
+
+  if (llr >= log((1 - beta) / alpha))
+    return SPRT_SLOW;
+  if (llr <= log(beta / (1 - alpha)))
+    return SPRT_HEALTHY;
+
+  // don't go above the maximal number of reads
+  if (n >= st->min_reads + st->max_reads)
+    return (llr > 0) ? SPRT_SLOW : SPRT_HEALTHY;
+
+  return SPRT_CONTINUE;
 }
 
 /**
@@ -1254,27 +2577,24 @@ compact_block_list(struct block_list_t* block_list, size_t glob)
  * @param soft_delay (flag) ignore blocks that don't have a single read above
  *      the delay (are unlikely to be really bad)
  * @param certain_bad (flag) add blocks that are certainly bad
- * @return null if there were no blocks meeting the criteria, null terminated
- * list otherwise
+ * @param block_list list to fill with found blocks, its memory is reused
+ * @return number of entries in block_list, 0 if there were no blocks meeting
+ * the criteria
  */
-struct block_list_t*
+size_t
 find_bad_blocks(struct status_t *st, struct block_info_t* block_info,
     size_t block_info_len,
     float min_std_dev, size_t min_reads, size_t glob, off_t offset, double delay,
-    int soft_delay, int certain_bad)
+    int soft_delay, int certain_bad, struct block_ranges_t* block_list)
 {
-  struct block_list_t* block_list;
-  struct block_list_t* ret;
-  size_t uncertain = 0;
+  struct block_range_t* ranges;
   size_t invalid = 0;
   size_t very_slow = 0;
 
-  if (offset > block_info_len || offset < 0)
-    return NULL;
+  br_clear(block_list);
 
-  block_list = calloc(sizeof(struct block_list_t), block_info_len + 1);
-  if (block_list == NULL)
-    err(EXIT_FAILURE, "find_uncertain_blocks");
+  if (offset > block_info_len || offset < 0)
+    return 0;
 
   // first thing to do in quick mode, is to get rid of invalid blocks
   if (st->quick && !certain_bad)
@@ -1284,13 +2604,15 @@ find_bad_blocks(struct status_t *st, struct block_info_t* block_info,
           if (!bi_is_initialised(&block_info[block_no]))
             continue;
 
+          // another read would take just as long
+          if (bi_get_timeout(&block_info[block_no]))
+            continue;
+
           // re-read blocks that didn't receive their share of proper reads
           if (bi_num_samples(&block_info[block_no]) < min_reads ||
               !bi_is_valid(&block_info[block_no]))
             {
-              block_list[uncertain].off = block_no;
-              block_list[uncertain].len = 1;
-              uncertain++;
+              br_add(block_list, block_no, 1);
               invalid++;
               continue;
             }
@@ -1300,12 +2622,11 @@ find_bad_blocks(struct status_t *st, struct block_info_t* block_info,
   if (st->quick && !invalid)
     for(size_t block_no=offset; block_no < block_info_len; block_no++)
       {
-        if (bi_quantile(&block_info[block_no],9,10) >= st->slow_lvl
+        if (bi_quantile(&block_info[block_no],9,10) >=
+            st->slow_lvl + zone_shift(st, block_no)
             && bi_num_samples(&block_info[block_no]) < 20)
           {
-            block_list[uncertain].off = block_no;
-            block_list[uncertain].len = 1;
-            uncertain++;
+            br_add(block_list, block_no, 1);
             very_slow++;
             continue;
           }
@@ -1315,13 +2636,15 @@ find_bad_blocks(struct status_t *st, struct block_info_t* block_info,
   if (!invalid && very_slow < 64)
     {
       double blk_decile;
+      double shift, fast_lvl, normal_lvl, slow_lvl, vslow_lvl;
       size_t blk_n_sampl;
 
       if (very_slow)
-        uncertain = 0; // we don't want duplicates...
+        br_clear(block_list); // we don't want duplicates...
       for (size_t block_no=offset; block_no < block_info_len; block_no++)
         {
-          if (!bi_is_initialised(&block_info[block_no]))
+          if (!bi_is_initialised(&block_info[block_no]) ||
+              bi_get_timeout(&block_info[block_no]))
             continue;
 
           blk_n_sampl = bi_num_samples(&block_info[block_no]);
@@ -1330,58 +2653,70 @@ find_bad_blocks(struct status_t *st, struct block_info_t* block_info,
           if (blk_n_sampl < min_reads ||
               !bi_is_valid(&block_info[block_no]))
             {
-              block_list[uncertain].off = block_no;
-              block_list[uncertain].len = 1;
-              uncertain++;
+              br_add(block_list, block_no, 1);
               continue;
             }
 
           blk_decile = bi_quantile(&block_info[block_no],9,10);
+          // blocks in outer zones read faster than in inner zones, the
+          // rotation period (st->fast_lvl) used for the modulo checks below
+          // stays the same in all zones
+          shift = zone_shift(st, block_no);
+          fast_lvl = st->fast_lvl + shift;
+          normal_lvl = st->normal_lvl + shift;
+          slow_lvl = st->slow_lvl + shift;
+          vslow_lvl = st->vslow_lvl + shift;
 
           // ignore fast sectors
-          if (blk_decile < st->fast_lvl)
+          if (blk_decile < fast_lvl)
             continue;
 
+          // let the sequential test decide how many samples are needed
+          if (st->sprt)
+            {
+              int decision = sprt_decide(st, &block_info[block_no],
+                  fast_lvl);
+
+              if (decision == SPRT_CONTINUE ||
+                  (decision == SPRT_SLOW && certain_bad == 1))
+                {
+                  br_add(block_list, block_no, 1);
+                }
+              continue;
+            }
+
           // check if a single out-of-ordinary result is not a fluke
           if (blk_n_sampl <= 2 &&
-              blk_decile > st->fast_lvl)
+              blk_decile > fast_lvl)
             {
-              block_list[uncertain].off = block_no;
-              block_list[uncertain].len = 1;
-              uncertain++;
+              br_add(block_list, block_no, 1);
               continue;
             }
 
           // big claims need big evidence
-          if (blk_decile >= st->normal_lvl
+          if (blk_decile >= normal_lvl
               && blk_n_sampl < 15)
             {
-              block_list[uncertain].off = block_no;
-              block_list[uncertain].len = 1;
-              uncertain++;
+              br_add(block_list, block_no, 1);
               continue;
             }
 
-          if (blk_decile >= st->slow_lvl
+          if (blk_decile >= slow_lvl
               && blk_n_sampl < 20)
             {
-              block_list[uncertain].off = block_no;
-              block_list[uncertain].len = 1;
-              uncertain++;
+              br_add(block_list, block_no, 1);
               continue;
             }
 
-          if (blk_decile >= st->vslow_lvl
+          if (blk_decile >= vslow_lvl
               && blk_n_sampl < 30)
             {
-              block_list[uncertain].off = block_no;
-              block_list[uncertain].len = 1;
-              uncertain++;
+              br_add(block_list, block_no, 1);
               continue;
             }
 
           // process only sectors with slow sectors
-          if (blk_decile >= st->fast_lvl)
+          if (blk_decile >= fast_lvl)
             {
               double lq, max;
               size_t num_samples;
@@ -1398,17 +2733,15 @@ find_bad_blocks(struct status_t *st, struct block_info_t* block_info,
                   high = high - st->fast_lvl * floor(high/st->fast_lvl);
 
                   // check if it's not a fluke
-                  if ( low < st->fast_lvl && med < st->fast_lvl
+                  if ( low < fast_lvl && med < fast_lvl
                       && abs((low+med)/2-high) > st->fast_lvl/4 )
                     continue;
 
                   // if the difference is big, the sector is probably shot,
                   // check to make sure
-                  if ( max > st->normal_lvl)
+                  if ( max > normal_lvl)
                     {
-                      block_list[uncertain].off = block_no;
-                      block_list[uncertain].len = 1;
-                      uncertain++;
+                      br_add(block_list, block_no, 1);
                       continue;
                     }
                   else // single re-read only, ignore
@@ -1417,15 +2750,13 @@ find_bad_blocks(struct status_t *st, struct block_info_t* block_info,
 
               if (num_samples <= 5)
                 {
-                  if (lq > st->fast_lvl)
+                  if (lq > fast_lvl)
                     {
                       // if more than 4 reads show the sector as slower than
                       // rotational delay, the sector is certainly shot
                       if (certain_bad == 1)
                         {
-                          block_list[uncertain].off = block_no;
-                          block_list[uncertain].len = 1;
-                          uncertain++;
+                          br_add(block_list, block_no, 1);
                           continue;
                         }
                       else
@@ -1444,9 +2775,7 @@ find_bad_blocks(struct status_t *st, struct block_info_t* block_info,
                     {
                       if (certain_bad == 1)
                         {
-                          block_list[uncertain].off = block_no;
-                          block_list[uncertain].len = 1;
-                          uncertain++;
+                          br_add(block_list, block_no, 1);
                           continue;
                         }
                       else
@@ -1458,13 +2787,11 @@ find_bad_blocks(struct status_t *st, struct block_info_t* block_info,
                   if (max/st->fast_lvl - high/st->fast_lvl >= 2
                       && num_samples < 15)
                     {
-                      block_list[uncertain].off = block_no;
-                      block_list[uncertain].len = 1;
-                      uncertain++;
+                      br_add(block_list, block_no, 1);
                       continue;
                     }
 
-                  if (high > st->fast_lvl)
+                  if (high > fast_lvl)
                     {
                       high = high - st->fast_lvl * floor(high/st->fast_lvl);
                       max = max - st->fast_lvl * floor(high/st->fast_lvl);
@@ -1473,9 +2800,7 @@ find_bad_blocks(struct status_t *st, struct block_info_t* block_info,
                           // the reads are not a fluke
                           if (certain_bad == 1)
                             {
-                              block_list[uncertain].off = block_no;
-                              block_list[uncertain].len = 1;
-                              uncertain++;
+                              br_add(block_list, block_no, 1);
                               continue;
                             }
                           else
@@ -1483,21 +2808,17 @@ find_bad_blocks(struct status_t *st, struct block_info_t* block_info,
                         }
                       else
                         {
-                          block_list[uncertain].off = block_no;
-                          block_list[uncertain].len = 1;
-                          uncertain++;
+                          br_add(block_list, block_no, 1);
                           continue;
                         }
                     }
 
                   if (bi_quantile_exact(&block_info[block_no],num_samples-2
-                        ,num_samples) > st->fast_lvl)
+                        ,num_samples) > fast_lvl)
                     {
                       if (certain_bad == 1)
                         {
-                          block_list[uncertain].off = block_no;
-                          block_list[uncertain].len = 1;
-                          uncertain++;
+                          br_add(block_list, block_no, 1);
                           continue;
                         }
                       else
@@ -1510,9 +2831,7 @@ find_bad_blocks(struct status_t *st, struct block_info_t* block_info,
 
               if (num_samples >= 20 && certain_bad == 1)
                 {
-                  block_list[uncertain].off = block_no;
-                  block_list[uncertain].len = 1;
-                  uncertain++;
+                  br_add(block_list, block_no, 1);
                   continue;
                 }
               else
@@ -1521,69 +2840,57 @@ find_bad_blocks(struct status_t *st, struct block_info_t* block_info,
         }
     }
 
-  if (uncertain == 0)
-    {
-      free(block_list);
-      return NULL;
-    }
+  if (block_list->len == 0)
+    return 0;
 
   // recheck only the worst sectors in quick mode but all invalid and all very
   // slow
+  ranges = block_list->ranges;
   if (st->quick && !invalid && very_slow < 64)
     {
       static int first = 2;
-      sort_worst_block_list(st, block_info, block_info_len, block_list,
-          uncertain);
+      sort_worst_block_list(st, block_info, block_info_len, ranges,
+          block_list->len);
       if (first)
         {
-          if (uncertain > 1024)
+          if (block_list->len > 1024)
             {
               // move 1024 worst blocks from the bottom
               size_t from, dest;
-              assert(uncertain - 1 > 1023);
-              for (from = uncertain - 1024, dest = 0;
+              for (from = block_list->len - 1024, dest = 0;
                   dest < 1024;
                   from++, dest++)
                 {
-                  block_list[dest].off = block_list[from].off;
+                  ranges[dest].off = ranges[from].off;
                 }
-              block_list[1024].off = 0;
-              block_list[1024].len = 0;
-              uncertain = 1024;
+              block_list->len = 1024;
             }
           first--;
         }
       else
         {
-          if (uncertain > 64)
+          if (block_list->len > 64)
             {
               // move 64 worst blocks up
               size_t from, dest;
-              assert(uncertain - 1 > 63);
-              for (from = uncertain - 64, dest = 0;
+              for (from = block_list->len - 64, dest = 0;
                   dest < 64;
                   from++, dest++)
                 {
-                  block_list[dest].off = block_list[from].off;
+                  ranges[dest].off = ranges[from].off;
                 }
-              block_list[64].off = 0;
-              block_list[64].len = 0;
-              uncertain = 64;
+              block_list->len = 64;
             }
         }
 
-      qsort(block_list, uncertain, sizeof(struct block_list_t), __off_t_compare);
+      br_sort(block_list);
     }
 
   // check if need to do some globbing
-  if (glob == 1)
-    return block_list;
-
-  ret = compact_block_list(block_list, glob);
-
-  free(block_list);
+  if (glob != 1)
+    br_compact(block_list, glob);
 
-  return ret;
+  return block_list->len;
 }
 
 /** Find blocks that could be bad
@@ -1598,27 +2905,28 @@ find_bad_blocks(struct status_t *st, struct block_info_t* block_info,
  * @param delay read delay for the block to be considered uncertain
  * @param soft_delay (flag) ignore blocks that don't have a single read above
  *      the delay (are unlikely to be really bad)
- * @return null if there were no blocks meeting the criteria, null terminated
- * list otherwise
+ * @param block_list list to fill with found blocks, its memory is reused
+ * @return number of entries in block_list, 0 if there were no blocks meeting
+ * the criteria
  */
-struct block_list_t*
+size_t
 find_uncertain_blocks(struct status_t *st, struct block_info_t* block_info,
     size_t block_info_len,
     float min_std_dev, size_t min_reads, size_t glob, off_t offset, double delay,
-    int soft_delay)
+    int soft_delay, struct block_ranges_t* block_list)
 {
   return find_bad_blocks(st, block_info, block_info_len, min_std_dev,
-      min_reads, glob, offset, delay, soft_delay, 0);
+      min_reads, glob, offset, delay, soft_delay, 0, block_list);
 }
 
-struct block_list_t*
+/**
+ * fill list with number worst blocks, best of them first
+ */
+void
 find_worst_blocks(struct status_t *st, struct block_info_t *block_info,
-    size_t block_info_len, size_t number)
+    size_t block_info_len, size_t number, struct block_ranges_t *list)
 {
-  struct block_list_t *block_list = calloc(sizeof(struct block_list_t),
-                                                  block_info_len + 1);
-  if (block_list == NULL)
-    err(EXIT_FAILURE, "find_worst_blocks");
+  struct block_range_t *block_list;
 
   // assert
   if (number >= block_info_len)
@@ -1628,11 +2936,10 @@ find_worst_blocks(struct status_t *st, struct block_info_t *block_info,
       exit(EXIT_FAILURE);
     }
 
+  br_clear(list);
   for (size_t i=0; i < number; i++)
-    {
-      block_list[i].off = i;
-      block_list[i].len = 1;
-    }
+    br_add(list, i, 1);
+  block_list = list->ranges;
 
   sort_worst_block_list(st, block_info, block_info_len,
       block_list, number);
@@ -1650,8 +2957,6 @@ find_worst_blocks(struct status_t *st, struct block_info_t *block_info,
                 block_list, number);
           }
     }
-
-  return block_list;
 }
 
 void
@@ -1698,9 +3003,325 @@ write_to_file(struct status_t *st, char *file,
   fclose(handle);
 }
 
+/**
+ * write heatmap of read latencies as image and multi-resolution pyramid
+ *
+ * The pyramid file (prefix.pyr) starts with "HDCKPYR1", followed by number
+ * of levels, number of rows, number of sectors in block (uint32_t), number
+ * of blocks (uint64_t), shortest latency in ms and rows per decade (double),
+ * all in host byte order. Every level follows as its width (uint32_t) and
+ * width * rows of uint32_t counts, column after column. Level 0 is the
+ * finest, every next one has half the columns. Last row counts read errors.
+ *
+ * The image (prefix.ppm) shows the widest level not wider than
+ * HEATMAP_IMAGE_WIDTH, the slowest reads at the top and read errors in red.
+ */
 void
-write_list_to_file(struct status_t *st, char* file,
-    struct block_list_t* block_list)
+write_heatmap(struct status_t *st, const char *prefix)
+{
+  uint32_t *level, *coarser;
+  uint32_t *image_level = NULL;
+  size_t width = st->heatmap_width;
+  size_t image_width = 0;
+  uint32_t levels = 0;
+  uint32_t max_count = 0;
+  char *path;
+  FILE *pyr, *ppm;
+
+  path = malloc(strlen(prefix) + 5);
+  if (path == NULL)
+    err(EXIT_FAILURE, "write_heatmap");
+
+  sprintf(path, "%s.pyr", prefix);
+  pyr = fopen(path, "w");
+  if (pyr == NULL)
+    err(EXIT_FAILURE, "%s", path);
+
+  for (size_t w = width; w > 0; w /= 2)
+    levels++;
+
+  {
+    uint32_t rows = HEATMAP_ROWS;
+    uint32_t sectors = st->sectors;
+    uint64_t blocks = st->number_of_blocks;
+    double min_latency = HEATMAP_MIN_LATENCY;
+    double per_decade = HEATMAP_ROWS_PER_DECADE;
+
+    fwrite("HDCKPYR1", 1, 8, pyr);
+    fwrite(&levels, sizeof(levels), 1, pyr);
+    fwrite(&rows, sizeof(rows), 1, pyr);
+    fwrite(&sectors, sizeof(sectors), 1, pyr);
+    fwrite(&blocks, sizeof(blocks), 1, pyr);
+    fwrite(&min_latency, sizeof(min_latency), 1, pyr);
+    fwrite(&per_decade, sizeof(per_decade), 1, pyr);
+  }
+
+  level = st->heatmap;
+  while (1)
+    {
+      uint32_t w = width;
+
+      fwrite(&w, sizeof(w), 1, pyr);
+      fwrite(level, sizeof(uint32_t), width * HEATMAP_ROWS, pyr);
+
+      if (image_level == NULL && width <= HEATMAP_IMAGE_WIDTH)
+        {
+          image_level = malloc(sizeof(uint32_t) * width * HEATMAP_ROWS);
+          if (image_level == NULL)
+            err(EXIT_FAILURE, "write_heatmap");
+          memcpy(image_level, level, sizeof(uint32_t) * width * HEATMAP_ROWS);
+          image_width = width;
+        }
+
+      if (width == 1)
+        break;
+
+      // every column of coarser level is the sum of two finer columns
+      coarser = calloc(width / 2 * HEATMAP_ROWS, sizeof(uint32_t));
+      if (coarser == NULL)
+        err(EXIT_FAILURE, "write_heatmap");
+      for (size_t i=0; i < width / 2 * HEATMAP_ROWS; i++)
+        {
+          size_t column = i / HEATMAP_ROWS, row = i % HEATMAP_ROWS;
+          uint64_t sum = (uint64_t)level[2 * column * HEATMAP_ROWS + row] +
+            level[(2 * column + 1) * HEATMAP_ROWS + row];
+          coarser[i] = (sum > UINT32_MAX) ? UINT32_MAX : sum;
+        }
+
+      if (level != st->heatmap)
+        free(level);
+      level = coarser;
+      width /= 2;
+    }
+  if (level != st->heatmap)
+    free(level);
+
+  if (fclose(pyr) != 0)
+    err(EXIT_FAILURE, "%s", path);
+
+  sprintf(path, "%s.ppm", prefix);
+  ppm = fopen(path, "w");
+  if (ppm == NULL)
+    err(EXIT_FAILURE, "%s", path);
+
+  for (size_t i=0; i < image_width * HEATMAP_ROWS; i++)
+    if (image_level[i] > max_count)
+      max_count = image_level[i];
+
+  fprintf(ppm, "P6\n%zi %i\n255\n", image_width, HEATMAP_ROWS);
+  // errors on top, then from the slowest to the fastest reads
+  for (int row = HEATMAP_ROWS - 1; row >= 0; row--)
+    for (size_t column = 0; column < image_width; column++)
+      {
+        uint32_t count = image_level[column * HEATMAP_ROWS + row];
+        unsigned char value = 0;
+
+        // log scale, so that single slow reads are visible
+        if (count > 0)
+          value = 64 + 191 * log1p(count) / log1p(max_count);
+
+        if (row == HEATMAP_ROWS - 1)
+          fprintf(ppm, "%c%c%c", value, 0, 0);
+        else
+          fprintf(ppm, "%c%c%c", value, value, value);
+      }
+
+  if (fclose(ppm) != 0)
+    err(EXIT_FAILURE, "%s", path);
+
+  free(image_level);
+  free(path);
+}
+
+/**
+ * write unreadable or timed out block as JSON object
+ */
+void
+json_write_bad_block(struct json_writer_t *json, struct status_t *st,
+    struct block_info_t *block_info, off_t block)
+{
+  json_begin_object(json, NULL);
+  json_int(json, "block", block);
+  json_int(json, "first_lba", (long long)block * st->sectors);
+  json_int(json, "last_lba", (long long)(block + 1) * st->sectors - 1);
+  json_int(json, "errors", bi_get_error(&block_info[block]));
+  json_int(json, "timeouts", bi_get_timeout(&block_info[block]));
+  json_end_object(json);
+}
+
+/**
+ * write statistics of one of the worst blocks as JSON object
+ */
+void
+json_write_worst_block(struct json_writer_t *json, struct status_t *st,
+    struct block_info_t *block_info, off_t block)
+{
+  struct block_info_t *bi = &block_info[block];
+
+  json_begin_object(json, NULL);
+  json_int(json, "block", block);
+  json_int(json, "first_lba", (long long)block * st->sectors);
+  json_bool(json, "valid", bi_is_valid(bi));
+  json_int(json, "samples", bi_num_samples(bi));
+  json_int(json, "errors", bi_get_error(bi));
+  json_int(json, "timeouts", bi_get_timeout(bi));
+  if (bi_num_samples(bi) != 0)
+    {
+      json_double(json, "std_dev", bi_stdev(bi));
+      json_double(json, "average", bi_average(bi));
+      json_double(json, "q1", bi_quantile(bi, 1, 4));
+      json_double(json, "median", bi_quantile(bi, 2, 4));
+      json_double(json, "q3", bi_quantile(bi, 3, 4));
+      json_double(json, "decile9", bi_quantile(bi, 9, 10));
+    }
+  json_end_object(json);
+}
+
+/**
+ * write block thresholds and number of blocks and reads in every speed class
+ * as JSON objects
+ */
+void
+json_write_buckets(struct json_writer_t *json, struct status_t *st)
+{
+  json_begin_object(json, "thresholds_ms");
+  json_double(json, "vvfast", st->vvfast_lvl);
+  json_double(json, "vfast", st->vfast_lvl);
+  json_double(json, "fast", st->fast_lvl);
+  json_double(json, "normal", st->normal_lvl);
+  json_double(json, "slow", st->slow_lvl);
+  json_double(json, "vslow", st->vslow_lvl);
+  json_end_object(json);
+
+  json_begin_object(json, "blocks");
+  json_int(json, "vvfast", st->vvfast);
+  json_int(json, "vfast", st->vfast);
+  json_int(json, "fast", st->fast);
+  json_int(json, "normal", st->normal);
+  json_int(json, "slow", st->slow);
+  json_int(json, "vslow", st->vslow);
+  json_int(json, "vvslow", st->vvslow);
+  json_int(json, "errors", st->errors);
+  json_int(json, "timeouts", st->timeouts);
+  json_int(json, "invalid", st->invalid);
+  json_end_object(json);
+
+  json_begin_object(json, "reads");
+  json_int(json, "vvfast", st->tot_vvfast);
+  json_int(json, "vfast", st->tot_vfast);
+  json_int(json, "fast", st->tot_fast);
+  json_int(json, "normal", st->tot_normal);
+  json_int(json, "slow", st->tot_slow);
+  json_int(json, "vslow", st->tot_vslow);
+  json_int(json, "vvslow", st->tot_vvslow);
+  json_int(json, "errors", st->tot_errors);
+  json_int(json, "timeouts", st->tot_timeouts);
+  json_int(json, "interrupted", st->tot_interrupts);
+  json_end_object(json);
+}
+
+/**
+ * write list of block regions as JSON array
+ */
+static void
+json_write_regions(struct json_writer_t *json, struct status_t *st,
+    const char *key, struct block_ranges_t *list)
+{
+  json_begin_array(json, key);
+  for (size_t i=0; i < list->len; i++)
+    {
+      struct block_range_t *r = &list->ranges[i];
+
+      json_begin_object(json, NULL);
+      json_int(json, "first_block", r->off);
+      json_int(json, "last_block", (long long)r->off + r->len - 1);
+      json_int(json, "first_lba", (long long)r->off * st->sectors);
+      json_int(json, "last_lba",
+          ((long long)r->off + r->len) * st->sectors - 1);
+      json_end_object(json);
+    }
+  json_end_array(json);
+}
+
+/**
+ * write duration of test phases, speed profile, regions presumed bad,
+ * damaged ranges and zoomed sectors as JSON
+ */
+void
+json_write_profile(struct json_writer_t *json, struct status_t *st)
+{
+  json_begin_array(json, "loop_times_s");
+  for (size_t i=0; i < st->loop_times_len; i++)
+    json_double(json, NULL, st->loop_times[i]);
+  json_end_array(json);
+  json_double(json, "reread_time_s", st->reread_time);
+
+  if (st->speed != NULL)
+    {
+      json_begin_array(json, "speed_profile");
+      for (size_t i=0; i < st->speed_len; i++)
+        {
+          struct speed_bucket_t *bucket = &st->speed[i];
+
+          json_begin_object(json, NULL);
+          json_int(json, "first_lba",
+              (long long)(i * st->number_of_blocks / st->speed_len) *
+              st->sectors);
+          json_int(json, "blocks", bucket->blocks);
+          json_double(json, "mib_per_s", (bucket->time > 0) ?
+              bucket->blocks * st->sectors / 2048.0 / bucket->time : 0.0);
+          json_double(json, "median_ms", bucket->median);
+          json_int(json, "errors", bucket->errors);
+          json_end_object(json);
+        }
+      json_end_array(json);
+    }
+
+  json_write_regions(json, st, "presumed_bad_regions", &st->skipped);
+  json_write_regions(json, st, "unscanned_regions", &st->unscanned);
+
+  if (st->expand)
+    {
+      json_begin_array(json, "damaged_ranges");
+      for (size_t i=0; i < st->damaged_len; i++)
+        {
+          json_begin_object(json, NULL);
+          json_int(json, "first_lba", st->damaged[i].off);
+          json_int(json, "last_lba",
+              st->damaged[i].off + st->damaged[i].len - 1);
+          json_end_object(json);
+        }
+      json_end_array(json);
+    }
+
+  if (st->zoom)
+    {
+      json_begin_array(json, "slow_sectors");
+      for (size_t i=0; i < st->zoomed_len; i++)
+        {
+          struct sector_info_t *sector = &st->zoomed[i];
+
+          json_begin_object(json, NULL);
+          json_int(json, "lba", sector->lba);
+          json_int(json, "sectors", sector->len);
+          json_int(json, "errors", bi_get_error(&sector->times));
+          if (bi_num_samples(&sector->times) != 0)
+            json_double(json, "median_ms",
+                bi_quantile(&sector->times, 2, 4));
+          json_end_object(json);
+        }
+      json_end_array(json);
+    }
+}
+
+/**
+ * write list of ranges to file as LBAs
+ *
+ * @param unit size of list units in sectors
+ */
+static void
+write_ranges_to_file(char* file, struct block_list_t* block_list,
+    long long unit)
 {
   FILE* handle;
 
@@ -1710,45 +3331,56 @@ write_list_to_file(struct status_t *st, char* file,
 
   for(size_t i=0; !(block_list[i].off == 0 && block_list[i].len == 0); i++)
     if(fprintf(handle, "%lli %lli\n",
-        block_list[i].off * (long long)st->sectors,
-        (block_list[i].off + block_list[i].len) * (long long)st->sectors) == 0)
+        block_list[i].off * unit,
+        (block_list[i].off + block_list[i].len) * unit) == 0)
       err(EXIT_FAILURE, "write_list_to_file");
 
   fclose(handle);
 }
 
-struct block_list_t*
-read_list_from_file(struct status_t *st, char* file)
+void
+write_list_to_file(struct status_t *st, char* file,
+    struct block_ranges_t* block_list)
+{
+  FILE* handle;
+
+  handle = fopen(file, "w+");
+  if (handle == NULL)
+    err(EXIT_FAILURE,"write_list_to_file");
+
+  for(size_t i=0; i < block_list->len; i++)
+    if(fprintf(handle, "%lli %lli\n",
+        (long long)block_list->ranges[i].off * st->sectors,
+        ((long long)block_list->ranges[i].off + block_list->ranges[i].len)
+          * st->sectors) == 0)
+      err(EXIT_FAILURE, "write_list_to_file");
+
+  fclose(handle);
+}
+
+/**
+ * read list of LBA ranges from file
+ *
+ * @param block_list list to fill with read ranges, in blocks
+ * @return number of read ranges
+ */
+size_t
+read_list_from_file(struct status_t *st, char* file,
+    struct block_ranges_t* block_list)
 {
   FILE* handle = NULL;
-  size_t read_blocks = 0;
-  size_t alloc_elements = 16;
-  struct block_list_t* block_list = NULL;
 
   handle = fopen(file, "r");
   if (handle == NULL)
     err(EXIT_FAILURE, "read_list_from_file");
 
-  block_list = calloc(sizeof(struct block_list_t), alloc_elements);
-  if (block_list == NULL)
-    err(EXIT_FAILURE, "read_list_from_file");
+  br_clear(block_list);
 
   off_t off, len;
   off_t re;
 
   while(1)
     {
-      if (read_blocks + 2 >= alloc_elements)
-        {
-          alloc_elements=alloc_elements*2;
-          block_list = realloc(block_list,
-              sizeof(struct block_list_t)*alloc_elements);
-
-          if (block_list == NULL)
-            err(EXIT_FAILURE, "read_list_from_file");
-        }
-      assert(alloc_elements >= read_blocks);
-
       re = fscanf(handle, "%lli %lli\n", (long long *)&off, (long long *)&len);
       if (re == 0 || re < 0)
         break;
@@ -1757,77 +3389,596 @@ read_list_from_file(struct status_t *st, char* file)
         {
           fprintf(stderr, "end LBA is bigger than start LBA on line %zi in "
               "file %s\n",
-              read_blocks, file);
+              block_list->len, file);
           exit(EXIT_FAILURE);
         }
-      if (read_blocks > 0 && len < block_list[read_blocks-1].off)
+      if (block_list->len > 0 &&
+          len < block_list->ranges[block_list->len-1].off)
         {
           fprintf(stderr, "file %s not sorted!\n", file);
           exit(EXIT_FAILURE);
         }
+      if (off / st->sectors >= st->number_of_blocks)
+        {
+          fprintf(stderr, "range on line %zi in file %s is outside of the "
+              "device\n", block_list->len, file);
+          exit(EXIT_FAILURE);
+        }
+
+      off_t start = off / st->sectors; // round down
+      off_t blocks = ceill((len - off)*1.0L/st->sectors); // round up
 
-      block_list[read_blocks].off = off/st->sectors; // round down
-      // round up
-      block_list[read_blocks].len = ceill((len - off)*1.0L/st->sectors);
-      read_blocks++;
+      if (start + blocks > st->number_of_blocks)
+        blocks = st->number_of_blocks - start;
+
+      br_add(block_list, start, blocks);
     }
-  block_list[read_blocks].off = 0;
-  block_list[read_blocks].len = 0;
 
   fclose(handle);
 
-  if (read_blocks == 0)
-    {
-      free(block_list);
-      return NULL;
-    }
-  else
-    return block_list;
+  return block_list->len;
+}
+
+/// state shared with the nftw(3) callback used by read_fs_extents()
+struct extent_list_t {
+    struct status_t *st;
+    struct block_list_t *list; ///< collected extents, in hdck blocks
+    size_t len; ///< number of used entries
+    size_t alloc; ///< number of allocated entries
+    dev_t disk_dev; ///< device number of the tested device
+    dev_t fs_dev; ///< device number of the last looked up file system
+    off_t fs_offset; ///< byte offset of fs_dev on the tested device
+};
+
+/// extent list filled by _add_tree_extents(), nftw(3) has no user argument
+static struct extent_list_t *tree_extent_list;
+
+/**
+ * find where the file system device starts on the tested device
+ *
+ * @return offset in bytes, -1 if the file system doesn't reside on it
+ */
+off_t
+get_fs_offset(dev_t fs_dev, dev_t disk_dev)
+{
+  char path[64];
+  FILE *handle;
+  unsigned int maj, min;
+  long long start;
+
+  if (fs_dev == disk_dev)
+    return 0;
+
+  // partitions have the whole disk as the parent directory in sysfs
+  snprintf(path, sizeof(path), "/sys/dev/block/%u:%u/../dev",
+      major(fs_dev), minor(fs_dev));
+  handle = fopen(path, "r");
+  if (handle == NULL)
+    return -1;
+  if (fscanf(handle, "%u:%u", &maj, &min) != 2)
+    maj = min = 0;
+  fclose(handle);
+
+  if (makedev(maj, min) != disk_dev)
+    return -1;
+
+  snprintf(path, sizeof(path), "/sys/dev/block/%u:%u/start",
+      major(fs_dev), minor(fs_dev));
+  handle = fopen(path, "r");
+  if (handle == NULL)
+    return -1;
+  if (fscanf(handle, "%lli", &start) != 1)
+    start = -1;
+  fclose(handle);
+
+  if (start < 0)
+    return -1;
+
+  return start * 512;
 }
 
+/**
+ * add extent (in bytes, relative to the start of file system) to the list
+ */
 void
-read_block_list(struct status_t *st, int dev_fd,
-    struct block_list_t* block_list,
-    struct block_info_t* block_info, char* dev_stat_path,
-    off_t number_of_blocks)
+add_fs_extent(struct extent_list_t *ext, off_t physical, off_t length)
 {
-  uint16_t correct_reads = 0xffff;
-  off_t total_blocks = 0; ///< total number of blocks to be read
-                          /// (with overhead)
-  off_t blocks_read = 0; ///< number of blocks read (with overhead)
-  struct block_list_t* tmp_block_list; ///< compacted block_list
-  static size_t max_len = 4; ///< globbing param for compacting
-  /// disk cache size in blocks
-  off_t disk_cache = st->disk_cache_size * 1024 * 1024 / st->sectors / 512;
-  struct timespec start_time, end_time, res; ///< expected time calculation
-  size_t block_number=0; ///< position in the block_list
-  struct block_info_t* block_data; ///< stats for sectors read
-  unsigned int info;
+  off_t block_size = ext->st->sectors * 512;
+  off_t start, end;
 
-  if (st->verbosity > 6)
-    print_block_list(block_list);
-  tmp_block_list = compact_block_list(block_list, max_len * 2);
-  if (st->verbosity > 6)
+  if (length <= 0)
+    return;
+
+  start = (ext->fs_offset + physical) / block_size; // round down
+  end = (ext->fs_offset + physical + length + block_size - 1) / block_size;
+
+  if (start >= ext->st->number_of_blocks)
+    return;
+  if (end > ext->st->number_of_blocks)
+    end = ext->st->number_of_blocks;
+
+  if (ext->len + 2 >= ext->alloc)
     {
-      printf("after compacting:\n");
-      print_block_list(tmp_block_list);
+      ext->alloc *= 2;
+      ext->list = realloc(ext->list, sizeof(struct block_list_t) * ext->alloc);
+      if (ext->list == NULL)
+        err(EXIT_FAILURE, "add_fs_extent");
     }
 
-  // count the total number of blocks that will be read
-  for (size_t i=0; !(tmp_block_list[i].off==0 && tmp_block_list[i].len==0);
-      i++)
-    // 16 blocks are needed for meaningful results through USB bridges
-    total_blocks += tmp_block_list[i].len + 1 + 15 * st->usb_mode + 3;
+  ext->list[ext->len].off = start;
+  ext->list[ext->len].len = end - start;
+  ext->len++;
+}
 
-  // empty internal disk cache by reading twice the size of cache
-  // but only when reads by themselves won't do it
-  if (total_blocks <= disk_cache *2)
-    {
-      if(st->ata_verify)
-        {
-          sg_ll_verify10(dev_fd, 0, 0, 0,
-              (unsigned int)0, st->sectors*disk_cache*2, NULL, 0, &info, 1,
-              st->verbosity);
+/**
+ * set the file system the following extents belong to
+ *
+ * The result of the lookup is kept, also when the file system isn't on the
+ * tested device, so that sysfs is read only when the device changes.
+ *
+ * @return 0 if the file system is on the tested device, -1 otherwise
+ */
+int
+set_fs_device(struct extent_list_t *ext, dev_t fs_dev)
+{
+  if (ext->fs_dev == fs_dev)
+    return (ext->fs_offset < 0) ? -1 : 0;
+
+  ext->fs_dev = fs_dev;
+  ext->fs_offset = get_fs_offset(fs_dev, ext->disk_dev);
+
+  if (ext->fs_offset < 0)
+    return -1;
+  return 0;
+}
+
+/**
+ * collect extents of a single file using FIEMAP
+ */
+void
+add_file_extents(struct extent_list_t *ext, const char *path)
+{
+  struct stat file_stat;
+  struct fiemap *fiemap;
+  const size_t count = 256;
+  int fd;
+
+  fd = open(path, O_RDONLY | O_NOFOLLOW | O_NONBLOCK);
+  if (fd < 0)
+    {
+      if (ext->st->verbosity > 1)
+        warn("%s", path);
+      return;
+    }
+
+  if (fstat(fd, &file_stat) == -1 || !S_ISREG(file_stat.st_mode) ||
+      set_fs_device(ext, file_stat.st_dev) != 0)
+    {
+      close(fd);
+      return;
+    }
+
+  fiemap = malloc(sizeof(struct fiemap) + count * sizeof(struct fiemap_extent));
+  if (fiemap == NULL)
+    err(EXIT_FAILURE, "add_file_extents");
+
+  memset(fiemap, 0, sizeof(struct fiemap));
+  fiemap->fm_length = FIEMAP_MAX_OFFSET;
+  // don't flush dirty data of every file, delayed allocations are skipped
+  fiemap->fm_flags = 0;
+  fiemap->fm_extent_count = count;
+
+  while (1)
+    {
+      int last = 0;
+
+      if (ioctl(fd, FS_IOC_FIEMAP, fiemap) == -1)
+        {
+          if (ext->st->verbosity > 1)
+            warn("FIEMAP: %s", path);
+          break;
+        }
+
+      if (fiemap->fm_mapped_extents == 0)
+        break;
+
+      for (size_t i=0; i < fiemap->fm_mapped_extents; i++)
+        {
+          struct fiemap_extent *fe = &fiemap->fm_extents[i];
+
+          if (fe->fe_flags & FIEMAP_EXTENT_LAST)
+            last = 1;
+
+          // extents without well defined position on the device
+          if (fe->fe_flags & (FIEMAP_EXTENT_UNKNOWN | FIEMAP_EXTENT_DELALLOC
+                | FIEMAP_EXTENT_DATA_INLINE | FIEMAP_EXTENT_NOT_ALIGNED))
+            continue;
+
+          add_fs_extent(ext, fe->fe_physical, fe->fe_length);
+        }
+
+      if (last)
+        break;
+
+      struct fiemap_extent *fe =
+        &fiemap->fm_extents[fiemap->fm_mapped_extents-1];
+      fiemap->fm_start = fe->fe_logical + fe->fe_length;
+      fiemap->fm_length = FIEMAP_MAX_OFFSET - fiemap->fm_start;
+    }
+
+  free(fiemap);
+  close(fd);
+}
+
+/**
+ * nftw(3) callback for read_fs_extents()
+ */
+static int
+_add_tree_extents(const char *path, const struct stat *sb, int flag,
+    struct FTW *ftwbuf)
+{
+  if (flag == FTW_F && S_ISREG(sb->st_mode))
+    add_file_extents(tree_extent_list, path);
+
+  return 0;
+}
+
+/**
+ * collect in-use extents of the file system mounted at path using GETFSMAP
+ *
+ * @return 0 on success, -1 if the file system doesn't support GETFSMAP
+ */
+int
+add_fsmap_extents(struct extent_list_t *ext, const char *path)
+{
+  struct fsmap_head *head;
+  const size_t count = 1024;
+  int fd;
+  int ret = 0;
+
+  fd = open(path, O_RDONLY | O_DIRECTORY);
+  if (fd < 0)
+    err(EXIT_FAILURE, "%s", path);
+
+  head = calloc(1, fsmap_sizeof(count));
+  if (head == NULL)
+    err(EXIT_FAILURE, "add_fsmap_extents");
+
+  head->fmh_count = count;
+  head->fmh_keys[1].fmr_device = UINT32_MAX;
+  head->fmh_keys[1].fmr_flags = UINT32_MAX;
+  head->fmh_keys[1].fmr_physical = ULLONG_MAX;
+  head->fmh_keys[1].fmr_owner = ULLONG_MAX;
+  head->fmh_keys[1].fmr_offset = ULLONG_MAX;
+
+  while (1)
+    {
+      if (ioctl(fd, FS_IOC_GETFSMAP, head) == -1)
+        {
+          if (errno != ENOTTY && errno != EOPNOTSUPP && errno != EINVAL)
+            err(EXIT_FAILURE, "GETFSMAP: %s", path);
+          ret = -1;
+          break;
+        }
+
+      if (head->fmh_entries == 0)
+        break;
+
+      for (size_t i=0; i < head->fmh_entries; i++)
+        {
+          struct fsmap *rec = &head->fmh_recs[i];
+          dev_t dev;
+
+          if ((rec->fmr_flags & FMR_OF_SPECIAL_OWNER) &&
+              rec->fmr_owner == FMR_OWN_FREE)
+            continue;
+
+          if (head->fmh_oflags & FMH_OF_DEV_T)
+            dev = makedev(major(rec->fmr_device), minor(rec->fmr_device));
+          else
+            {
+              struct stat dir_stat;
+              if (fstat(fd, &dir_stat) == -1)
+                err(EXIT_FAILURE, "fstat");
+              dev = dir_stat.st_dev;
+            }
+
+          // skip external log and realtime devices not on tested disk
+          if (set_fs_device(ext, dev) != 0)
+            continue;
+
+          add_fs_extent(ext, rec->fmr_physical, rec->fmr_length);
+        }
+
+      if (head->fmh_recs[head->fmh_entries-1].fmr_flags & FMR_OF_LAST)
+        break;
+
+      fsmap_advance(head);
+    }
+
+  free(head);
+  close(fd);
+
+  return ret;
+}
+
+/**
+ * create list of blocks holding live file system data
+ *
+ * @param path mount point of the file system or file with list of paths
+ * (one per line) to scan
+ * @param ret list to fill with the extents, in blocks
+ * @return number of entries in ret, 0 if no extents on the tested device
+ * were found
+ */
+size_t
+read_fs_extents(struct status_t *st, int dev_fd, char *path,
+    struct block_ranges_t *ret)
+{
+  struct extent_list_t ext;
+  struct stat file_stat;
+  struct block_ranges_t compacted;
+
+  if (fstat(dev_fd, &file_stat) == -1)
+    err(EXIT_FAILURE, "fstat");
+  if (!S_ISBLK(file_stat.st_mode))
+    {
+      fprintf(stderr, "--fs-extents can be used only with block devices\n");
+      exit(EXIT_FAILURE);
+    }
+
+  ext.st = st;
+  ext.len = 0;
+  ext.alloc = 16;
+  ext.disk_dev = file_stat.st_rdev;
+  ext.fs_dev = 0;
+  ext.fs_offset = -1;
+  ext.list = calloc(sizeof(struct block_list_t), ext.alloc);
+  if (ext.list == NULL)
+    err(EXIT_FAILURE, "read_fs_extents");
+
+  if (stat(path, &file_stat) == -1)
+    err(EXIT_FAILURE, "%s", path);
+
+  if (S_ISDIR(file_stat.st_mode))
+    {
+      if (set_fs_device(&ext, file_stat.st_dev) != 0)
+        {
+          fprintf(stderr, "file system at %s doesn't reside on %s\n",
+              path, st->filename);
+          exit(EXIT_FAILURE);
+        }
+
+      // GETFSMAP reports metadata too and doesn't need to walk the tree
+      if (add_fsmap_extents(&ext, path) != 0)
+        {
+          if (st->verbosity > 0)
+            printf("GETFSMAP not supported, walking the directory tree\n");
+          ext.len = 0;
+          tree_extent_list = &ext;
+          if (nftw(path, _add_tree_extents, 64, FTW_PHYS | FTW_MOUNT) == -1)
+            err(EXIT_FAILURE, "nftw");
+        }
+    }
+  else
+    {
+      FILE *handle;
+      char *line = NULL;
+      size_t line_len = 0;
+      ssize_t nread;
+
+      handle = fopen(path, "r");
+      if (handle == NULL)
+        err(EXIT_FAILURE, "read_fs_extents");
+
+      while ((nread = getline(&line, &line_len, handle)) != -1)
+        {
+          if (nread > 0 && line[nread-1] == '\n')
+            line[nread-1] = '\0';
+          if (line[0] == '\0')
+            continue;
+          add_file_extents(&ext, line);
+        }
+
+      free(line);
+      fclose(handle);
+    }
+
+  br_clear(ret);
+  if (ext.len == 0)
+    {
+      free(ext.list);
+      return 0;
+    }
+
+  br_init(&compacted);
+  for (size_t i=0; i < ext.len; i++)
+    br_add(&compacted, ext.list[i].off, ext.list[i].len);
+  free(ext.list);
+
+  br_sort(&compacted);
+  br_compact(&compacted, 1);
+
+  // split long extents so that single interrupted read doesn't invalidate
+  // hundreds of MiB of samples, don't read more than 64 MiB at a time
+  off_t max_len = 64 * 1024 * 1024 / st->sectors / 512;
+
+  for (size_t i=0; i < compacted.len; i++)
+    {
+      off_t end = (off_t)compacted.ranges[i].off + compacted.ranges[i].len;
+
+      for (off_t off = compacted.ranges[i].off; off < end; off += max_len)
+        br_add(ret, off, (end - off > max_len) ? max_len : end - off);
+    }
+
+  br_free(&compacted);
+
+  return ret->len;
+}
+
+struct block_info_t *_uncertainty_compare_block_info;
+
+/**
+ * return how uncertain the result for the block is, slow blocks with few
+ * samples are the most uncertain
+ */
+double
+block_uncertainty(struct block_info_t *block_info)
+{
+  if (bi_get_error(block_info) || bi_get_timeout(block_info))
+    return 0.0; // certainly bad
+
+  if (!bi_is_initialised(block_info) || !bi_is_valid(block_info) ||
+      bi_num_samples(block_info) == 0)
+    return HUGE_VAL;
+
+  return bi_quantile(block_info, 9, 10) / sqrt(bi_num_samples(block_info));
+}
+
+static int
+_uncertainty_compare(const void *a, const void *b)
+{
+  double x, y;
+
+  x = block_uncertainty(
+      &_uncertainty_compare_block_info[((struct block_range_t*)a)->off]);
+  y = block_uncertainty(
+      &_uncertainty_compare_block_info[((struct block_range_t*)b)->off]);
+
+  // most uncertain first
+  if (x > y)
+    return -1;
+  else if (x == y)
+    return 0;
+  else
+    return 1;
+}
+
+/**
+ * leave only the most uncertain blocks on the list, so that they can be
+ * re-read before the deadline
+ *
+ * @param max_blocks number of blocks that can be re-read, see
+ * status_t.reread_cost
+ * @note This function is NOT thread safe!
+ */
+void
+limit_block_list(struct status_t *st, struct block_info_t *block_info,
+    struct block_ranges_t *block_list, size_t max_blocks)
+{
+  size_t len = block_list->len;
+  size_t entries = 0;
+  off_t blocks = 0;
+  off_t total = br_blocks(block_list);
+
+  if (max_blocks < 1)
+    max_blocks = 1;
+
+  if (total <= (off_t)max_blocks)
+    return;
+
+  _uncertainty_compare_block_info = block_info;
+  qsort(block_list->ranges, len, sizeof(struct block_range_t),
+      _uncertainty_compare);
+
+  // always leave at least one entry
+  do
+    blocks += block_list->ranges[entries++].len;
+  while (entries < len && blocks + block_list->ranges[entries].len <=
+      (off_t)max_blocks);
+
+  block_list->len = entries;
+  br_sort(block_list);
+
+  if (st->verbosity >= 0)
+    printf("not enough time left, re-reading only %lli most uncertain of "
+        "%lli blocks%s\n", (long long)blocks, (long long)total,
+        CLEAR_LINE_END);
+  if (st->flog != NULL)
+    fprintf(st->flog, "not enough time left, re-reading only %lli most "
+        "uncertain of %lli blocks\n", (long long)blocks, (long long)total);
+}
+
+/**
+ * save blocks that weren't read or still are uncertain to file, so that the
+ * test can be resumed using --read-sectors
+ */
+void
+write_state_to_file(struct status_t *st, char *file,
+    struct block_info_t *block_info)
+{
+  struct block_ranges_t uncertain;
+  struct block_ranges_t state;
+  size_t u = 0;
+
+  br_init(&uncertain);
+  br_init(&state);
+
+  find_uncertain_blocks(st, block_info, st->number_of_blocks,
+      st->max_std_dev, st->min_reads, 1, 0, st->rotational_delay, 1,
+      &uncertain);
+
+  for (off_t i=0; i < st->number_of_blocks; i++)
+    {
+      int add = 0;
+
+      if (!bi_is_initialised(&block_info[i]))
+        add = 1;
+
+      while (u < uncertain.len &&
+          uncertain.ranges[u].off + uncertain.ranges[u].len <= i)
+        u++;
+      if (u < uncertain.len && uncertain.ranges[u].off <= i)
+        add = 1;
+
+      if (add)
+        br_extend(&state, i);
+    }
+
+  write_list_to_file(st, file, &state);
+
+  br_free(&uncertain);
+  br_free(&state);
+}
+
+void
+read_block_list(struct status_t *st, int dev_fd,
+    struct block_ranges_t* block_list,
+    struct block_info_t* block_info, char* dev_stat_path,
+    off_t number_of_blocks)
+{
+  uint16_t correct_reads = 0xffff;
+  off_t total_blocks = 0; ///< total number of blocks to be read
+                          /// (with overhead)
+  off_t blocks_read = 0; ///< number of blocks read (with overhead)
+  static size_t max_len = 8; ///< maximal length of merged range
+  int direction = st->reread_direction; ///< direction of the sweep
+  size_t list_pos = 0; ///< number of entries from block_list already used
+  off_t gap; ///< maximal number of blocks read between entries
+  struct block_range_t range; ///< currently processed range
+  /// disk cache size in blocks
+  off_t disk_cache = st->disk_cache_size * 1024 * 1024 / st->sectors / 512;
+  struct timespec start_time, end_time, res; ///< expected time calculation
+  struct block_info_t* block_data; ///< stats for sectors read
+  off_t listed_blocks = 0; ///< number of blocks from block_list read
+  size_t used_pos = 0; ///< list_pos of entries counted in listed_blocks
+
+  if (st->verbosity > 6)
+    print_block_list(block_list);
+
+  gap = reread_merge_gap(st);
+
+  // count the total number of blocks that will be read
+  total_blocks = remaining_range_blocks(st, block_list, 0, direction,
+      max_len, gap);
+
+  // empty internal disk cache by reading twice the size of cache
+  // but only when reads by themselves won't do it
+  if (total_blocks <= disk_cache *2)
+    {
+      if(st->ata_verify)
+        {
+          read_sectors(st, dev_fd, NULL, 0, st->sectors*disk_cache*2);
           // XXX ignore errors
           if(lseek(dev_fd, st->sectors*disk_cache*2*512, SEEK_SET) < 0)
             err(1,"read_block_list:can't seek");
@@ -1837,35 +3988,45 @@ read_block_list(struct status_t *st, int dev_fd,
           if(lseek(dev_fd, 0, SEEK_SET) < 0)
             err(1,"read_block_list:can't seek");
 
-          char *buffer, *buffer_free;
-          buffer = malloc(st->sectors*512+pagesize);
-          if (buffer == NULL)
-            err(EXIT_FAILURE, "read_block_list");
-          buffer_free = buffer;
-          buffer = ptr_align(buffer, pagesize);
+          char *buffer = get_reread_buffer(st);
           for (size_t i=0; i < disk_cache*2; i++)
             {
-              read(dev_fd, buffer, st->sectors*512);
+              read_sectors(st, dev_fd, buffer, 0, st->sectors);
               //XXX ignore errors
             }
-          free(buffer_free);
         }
     }
 
   clock_gettime(TIMER_TYPE, &start_time);
-  while (!(tmp_block_list[block_number].off == 0 &&
-      tmp_block_list[block_number].len == 0))
+  while (next_block_range(block_list, &list_pos, direction, max_len, gap,
+        &range))
     {
       size_t offset, length;
-      offset = tmp_block_list[block_number].off;
-      length = tmp_block_list[block_number].len;
+
+      if (time_left(st) <= 0)
+        {
+          st->deadline_hit = 1;
+          break;
+        }
+
+      for (; used_pos < list_pos; used_pos++)
+        listed_blocks += block_list->ranges[(direction > 0) ? used_pos :
+            block_list->len - 1 - used_pos].len;
+
+      offset = range.off;
+      length = range.len;
       if (st->verbosity > 3)
         printf("processing block no %zi of length %zi\n",
             offset, length);
 
+      HDCK_PROBE2(chunk__start, offset, length);
+
       block_data = read_blocks(st, dev_fd, dev_stat_path, offset, length);
 
-      blocks_read += length + 1 + disk_cache*st->usb_mode + 3;
+      HDCK_PROBE3(chunk__done, offset, length,
+          block_data != NULL && bi_is_valid(&block_data[0]));
+
+      blocks_read += length + reread_overhead(st);
 
       if (block_data == NULL ||
           (block_data != NULL && !bi_is_valid(&block_data[0])))
@@ -1877,8 +4038,6 @@ read_block_list(struct status_t *st, int dev_fd,
             printf("!%s", CLEAR_LINE_END);// interrupted
 
           st->tot_interrupts++;
-
-          block_number++;
         }
       else if (st->verbosity <= 3 && st->verbosity > 2)
         printf(".%s", CLEAR_LINE_END); // OK
@@ -1919,54 +4078,15 @@ read_block_list(struct status_t *st, int dev_fd,
               for (size_t j=0; j < len; j++)
                 {
                   add_sample_to_stats(st, times[j]);
+                  update_heatmap(st, offset+i, times[j]);
                 }
+              for (int j=0; j < bi_get_error(&block_data[i]); j++)
+                update_heatmap(st, offset+i, -1.0);
             }
         }
 
-      // print statistics
-      if (st->verbosity >= 0 )
-        {
-          clock_gettime(TIMER_TYPE, &end_time);
-          diff_time(&res, start_time, end_time);
-
-          double percent;
-          percent = blocks_read * 1.0/total_blocks;
-
-          long long time_to_go;
-          time_to_go = time_double(res) / percent;
-          if (st->verbosity > 1)
-            printf("\n");
-
-          printf("reread %.2f%% done "
-              "in %02li:%02li:%02li, expected time:"
-              "%02lli:%02lli:%02lli%s\n",
-              percent * 100,
-              res.tv_sec/3600, res.tv_sec/60%60, res.tv_sec%60,
-              time_to_go/3600, time_to_go/60%60, time_to_go%60,
-              CLEAR_LINE_END);
-          printf("         Samples:             Blocks (9th decile):%s\n",
-              CLEAR_LINE_END);
-          printf("<%4.1fms: %20lli %20lli%s\n", st->vvfast_lvl, st->tot_vvfast,
-              st->vvfast, CLEAR_LINE_END);
-          printf("<%4.1fms: %20lli %20lli%s\n", st->vfast_lvl, st->tot_vfast,
-              st->vfast, CLEAR_LINE_END);
-          printf("<%4.1fms: %20lli %20lli%s\n", st->fast_lvl, st->tot_fast,
-              st->fast, CLEAR_LINE_END);
-          printf("<%4.1fms: %20lli %20lli%s\n", st->normal_lvl, st->tot_normal,
-              st->normal, CLEAR_LINE_END);
-          printf("<%4.1fms: %20lli %20lli%s\n", st->slow_lvl, st->tot_slow,
-              st->slow, CLEAR_LINE_END);
-          printf("<%4.1fms: %20lli %20lli%s\n", st->vslow_lvl, st->tot_vslow,
-              st->vslow, CLEAR_LINE_END);
-          printf(">%4.1fms: %20lli %20lli%s\n", st->vslow_lvl, st->tot_vvslow,
-              st->vvslow, CLEAR_LINE_END);
-          printf("ERR    : %20lli %20lli%s\n", st->tot_errors,
-              st->errors, CLEAR_LINE_END);
-          printf("Intrrpt: %20lli %20lli%s\n", st->tot_interrupts,
-              st->invalid, CLEAR_LINE_END);
-          printf("\r%s", cursor_up(11));
-          fflush(stdout);
-        }
+      publish_metrics(st, METRICS_DISPLAY_LIST, offset + length, 0, 0, 0,
+          blocks_read * 1.0/total_blocks);
 
       // save whether the read was successful
       if (block_data != NULL && bi_is_valid(&block_data[0]))
@@ -1990,92 +4110,43 @@ read_block_list(struct status_t *st, int dev_fd,
       // reduce the amount of blocks to read
       else if (bitcount(correct_reads) < 12)
         {
-          // divide the max len by half, recreate tmp_block_list
+          // divide the max len by half
           if (max_len > 2)
             {
               max_len /= 2;
-              off_t beginning = tmp_block_list[block_number].off;
-              if (st->verbosity > 7)
-                print_block_list(tmp_block_list);
-              free(tmp_block_list);
-
-              tmp_block_list = compact_block_list(block_list, max_len);
-              if (st->verbosity > 7)
-                {
-                  printf("after compacting:\n");
-                  print_block_list(tmp_block_list);
-                }
-
-              if (tmp_block_list == NULL)
-                break;
-
-              total_blocks = blocks_read;
-
-              size_t i=0;
-              while(!(tmp_block_list[i].off == 0 && tmp_block_list[i].len==0)
-                  && tmp_block_list[i].off + tmp_block_list[i].len < beginning)
-                i++;
-              block_number = i;
-
-              for (;
-                  !(tmp_block_list[i].off==0 && tmp_block_list[i].len==0);
-                  i++)
-                total_blocks += tmp_block_list[i].len + disk_cache + 3;
+              HDCK_PROBE2(max__len, max_len, bitcount(correct_reads));
+              total_blocks = blocks_read + remaining_range_blocks(st,
+                  block_list, list_pos, direction, max_len, gap);
             }
         }
       // if all reads were successful, double the amount of blocks read
       else if (bitcount(correct_reads) == 16)
         {
           // don't read more than 128 MiB at a time
-          if (max_len < 64 * 1024 * 1024 / st->sectors / 512)
+          if (max_len < 64 * 1024 * 1024 / st->sectors / 512 &&
+              // don't read more than can be finished before deadline
+              max_len * 2 * st->vvfast_lvl / 1000 < time_left(st) / 4)
             {
               max_len *= 2;
-              off_t beginning = tmp_block_list[block_number].off;
-              if (st->verbosity > 7)
-                print_block_list(tmp_block_list);
-              free(tmp_block_list);
-
-              tmp_block_list = compact_block_list(block_list, max_len);
-              if (st->verbosity > 7)
-                {
-                  printf("after compacting:\n");
-                  print_block_list(tmp_block_list);
-                }
-
-              if (tmp_block_list == NULL)
-                break;
-
-              if (tmp_block_list == NULL)
-                err(EXIT_FAILURE, "re_read");
-
-              total_blocks = blocks_read;
-
-              size_t i = 0;
-              while(!(tmp_block_list[i].off == 0 && tmp_block_list[i].len==0)
-                  && tmp_block_list[i].off + tmp_block_list[i].len < beginning)
-                i++;
-              block_number = i;
-
-              for (;
-                  !(tmp_block_list[i].off==0 && tmp_block_list[i].len==0);
-                  i++)
-                total_blocks += tmp_block_list[i].len + disk_cache + 3;
+              HDCK_PROBE2(max__len, max_len, bitcount(correct_reads));
+              total_blocks = blocks_read + remaining_range_blocks(st,
+                  block_list, list_pos, direction, max_len, gap);
             }
         }
 
-      if (block_data == NULL)
-        continue;
-
-      // free the block_data structure
-      for (size_t i=0; i< length; i++)
-        bi_clear(&block_data[i]);
+    }
 
-      free(block_data);
-      block_number++;
+  // save how long it takes to re-read a block, for deadline planning, the
+  // list is limited in blocks, not in merged ranges
+  if (listed_blocks > 0)
+    {
+      clock_gettime(TIMER_TYPE, &end_time);
+      diff_time(&res, start_time, end_time);
+      st->reread_cost = time_double(res) / listed_blocks;
     }
 
-  if (tmp_block_list)
-    free(tmp_block_list);
+  // don't redraw the status over messages printed after the re-read
+  set_metrics_phase(st, st->phase);
 
   printf("\n");
 }
@@ -2085,43 +4156,31 @@ perform_re_reads(struct status_t *st, int dev_fd, char* dev_stat_path,
     struct block_info_t* block_info, size_t block_info_size, size_t re_reads,
     double max_std_dev, size_t min_reads, double delay)
 {
-  struct block_list_t* block_list;
+  struct block_ranges_t block_list;
+
+  br_init(&block_list);
 
   for(size_t tries=0; tries < re_reads; tries++)
     {
+      if (find_uncertain_blocks(st, block_info, block_info_size, max_std_dev,
+            min_reads, 1, 0, delay, 1, &block_list) == 0)
+        {
+          if (st->verbosity >2)
+            printf("no uncertain blocks found%s\n", CLEAR_LINE_END);
+          break;
+        }
+
       // print statistics before processing
       if (st->verbosity >= 0)
         {
-          if (min_reads == 1)
-            block_list = find_uncertain_blocks(st,
-                block_info, block_info_size, max_std_dev, min_reads, 1, 0,
-                delay,
-                1);
-          else
-            block_list = find_uncertain_blocks(st,
-                block_info, block_info_size, max_std_dev, min_reads, 1, 0,
-                delay,
-                1);
-
-          if (block_list == NULL)
-            {
-              if (st->verbosity >2)
-                printf("no uncertain blocks found%s\n", CLEAR_LINE_END);
-              break;
-            }
-
-          size_t block_number=0;
           if (st->verbosity > 2)
-            printf("current uncertain blocks:%s\n", CLEAR_LINE_END);
-
-          // end of list is marked by NULL, NULL
-          while (!(block_list[block_number].off == 0 &&
-              block_list[block_number].len == 0))
             {
-              if (st->verbosity > 2)
+              printf("current uncertain blocks:%s\n", CLEAR_LINE_END);
+
+              for (size_t j=0; j < block_list.len; j++)
                 {
-                  size_t start = block_list[block_number].off,
-                        end = start + block_list[block_number].len;
+                  size_t start = block_list.ranges[j].off,
+                        end = start + block_list.ranges[j].len;
 
                   for(size_t i= start; i< end; i++)
                     {
@@ -2137,42 +4196,192 @@ perform_re_reads(struct status_t *st, int dev_fd, char* dev_stat_path,
                           CLEAR_LINE_END);
                     }
                 }
-              block_number++;
             }
 
-          printf("re-reading %zi uncertain blocks%s\n", block_number,
+          printf("re-reading %zi uncertain blocks%s\n", block_list.len,
               CLEAR_LINE_END);
-          free(block_list);
         }
 
+      if (st->deadline.tv_sec != 0)
+        {
+          double left = time_left(st);
 
-      if (min_reads == 1)
-        block_list = find_uncertain_blocks(st,
-            block_info, block_info_size, max_std_dev, min_reads, 1, 0, delay,
-            1);
-      else
-        block_list = find_uncertain_blocks(st,
-            block_info, block_info_size, max_std_dev, min_reads, 1, 0, delay,
-            1);
+          if (left <= 0)
+            {
+              st->deadline_hit = 1;
+              break;
+            }
 
-      if (block_list == NULL)
-        break;
+          if (st->reread_cost <= 0)
+            st->reread_cost = (st->rotational_delay +
+                reread_overhead(st) * st->vvfast_lvl) / 1000;
+
+          limit_block_list(st, block_info, &block_list,
+              left / st->reread_cost);
+        }
 
-      read_block_list(st, dev_fd, block_list, block_info, dev_stat_path,
+      read_block_list(st, dev_fd, &block_list, block_info, dev_stat_path,
           block_info_size);
 
+      // sweep the disk in the opposite direction in the next pass, so that
+      // the head doesn't have to travel over whole disk between passes
+      st->reread_direction = -st->reread_direction;
+
       if (st->verbosity <= 3 && st->verbosity >= 0)
         printf("%s\n", CLEAR_LINE_END);
 
-      if (block_list)
-        free(block_list);
-
       if (tries % 16 == 0)
         update_block_stats(st, block_info);
     }
+
+  br_free(&block_list);
   return;
 }
 
+/**
+ * create order in which runs of blocks are read in progressive mode
+ *
+ * First run is at the start of the disk, every next pass over the disk
+ * halves the stride between runs read so far, so that after every pass
+ * the read runs are evenly spread over whole disk
+ *
+ * @param runs number of runs the disk is divided into
+ * @param[out] stride initial stride, power of 2
+ */
+size_t*
+progressive_order(size_t runs, size_t *stride)
+{
+  size_t *order;
+  size_t n = 0;
+
+  *stride = 1;
+  while (*stride < runs)
+    *stride *= 2;
+
+  order = malloc(sizeof(size_t) * runs);
+  if (order == NULL)
+    err(EXIT_FAILURE, "progressive_order");
+
+  order[n++] = 0;
+  for (size_t s = *stride / 2; s >= 1; s /= 2)
+    for (size_t i = s; i < runs; i += 2 * s)
+      order[n++] = i;
+
+  assert(n == runs);
+
+  return order;
+}
+
+/**
+ * return pass of progressive scan in which the run is read
+ */
+int
+progressive_pass(size_t run, size_t stride) PURE_FUNCTION;
+
+int
+progressive_pass(size_t run, size_t stride)
+{
+  int pass = 0;
+
+  if (run == 0)
+    return 0;
+
+  while (run % stride != 0)
+    {
+      stride /= 2;
+      pass++;
+    }
+
+  return pass;
+}
+
+/**
+ * add range of blocks to regions skipped because of read errors, extending
+ * the region the range overlaps with, if any
+ */
+static void
+add_skipped_region(struct status_t *st, off_t start, off_t end)
+{
+  struct block_range_t *skipped = st->skipped.ranges;
+
+  for (size_t i=0; i < st->skipped.len; i++)
+    {
+      if (start < skipped[i].off ||
+          start > (off_t)skipped[i].off + skipped[i].len)
+        continue;
+      if (end > (off_t)skipped[i].off + skipped[i].len)
+        skipped[i].len = end - skipped[i].off;
+      return;
+    }
+
+  br_add(&st->skipped, start, end - start);
+}
+
+/**
+ * print list of block regions under a title, if it isn't empty
+ */
+static void
+print_regions(struct status_t *st, const char *title,
+    struct block_ranges_t *list)
+{
+  if (list->len == 0)
+    return;
+
+  if (st->verbosity >= 0)
+    printf("%s%s\n", title, CLEAR_LINE_END);
+  if (st->flog != NULL)
+    fprintf(st->flog, "%s\n", title);
+
+  for (size_t i=0; i < list->len; i++)
+    {
+      struct block_range_t *r = &list->ranges[i];
+
+      if (st->verbosity >= 0)
+        printf("blocks %lli-%lli (LBA: %lli-%lli)%s\n",
+            (long long)r->off,
+            (long long)r->off + r->len - 1,
+            (long long)r->off * (long long)st->sectors,
+            ((long long)r->off + r->len) * (long long)st->sectors - 1,
+            CLEAR_LINE_END);
+      if (st->flog != NULL)
+        fprintf(st->flog, "blocks %lli-%lli (LBA: %lli-%lli)\n",
+            (long long)r->off,
+            (long long)r->off + r->len - 1,
+            (long long)r->off * (long long)st->sectors,
+            ((long long)r->off + r->len) * (long long)st->sectors - 1);
+    }
+}
+
+/**
+ * number of blocks to skip after consecutive read errors
+ *
+ * Skip doubles with every error after the first, up to 1% of the disk
+ *
+ * @param streak number of consecutive errors
+ * @param limit number of blocks that can be skipped in current run
+ */
+static off_t
+error_skip_length(struct status_t *st, size_t streak, off_t limit)
+{
+  off_t skip;
+  off_t max_skip = st->number_of_blocks / 100;
+
+  if (streak < 2)
+    return 0;
+
+  skip = (off_t)1 << ((streak - 1 < 40) ? streak - 1 : 40);
+  if (max_skip < 1)
+    max_skip = 1;
+  if (skip > max_skip)
+    skip = max_skip;
+  if (skip > limit)
+    skip = limit;
+  if (skip < 0)
+    skip = 0;
+
+  return skip;
+}
+
 /**
  * @param dev_fd device file descriptor
  * @param block_info structure to which write sector data
@@ -2198,18 +4407,48 @@ read_whole_disk(struct status_t *st, int dev_fd, struct block_info_t* block_info
   int next_is_valid=1; ///< whether an erroneous read occurred and next sector
                        ///< can contain seek time
   size_t loop=0; ///< loop number
-  struct timespec time1, time2, /**< time it takes to read single block */
-                  res; /**< temp result */
-  int int_res;
+  int64_t time1, time2; ///< start and end of single block read, in ns
+  int64_t sample; ///< time it took to read the block, in ns
+  struct timespec res; ///< temp result
   off_t nread; ///< number of bytes the read() managed to read
   size_t blocks = 0; ///< number of blocks read in this run
   long long abs_blocks = 0; ///< number of blocks read in all runs
   struct timespec times, timee; ///< wall clock start and end
   off_t number_of_blocks; ///< filesize in blocks
+  off_t scan_blocks; ///< number of blocks to read in single loop
+  size_t pos = 0; ///< number of blocks read in this loop
+  size_t run_len; ///< length of the sequentially read run of blocks
+  size_t runs = 1; ///< number of runs the disk is divided into
+  size_t run = 0; ///< index of current run in run_order
+  size_t *run_order = NULL; ///< order in which runs are read
+  size_t stride = 1; ///< initial stride between runs in progressive mode
+  off_t run_start = 0; ///< first block of current run
+  off_t run_end; ///< block after the last block of current run
+  struct timespec loop_start; ///< wall clock start of current loop
+  size_t error_streak = 0; ///< number of consecutive read errors
+  off_t streak_start = 0; ///< first block of the error streak
+  long long faults; ///< page faults taken before the scan
+  size_t spills; ///< blocks moved off preallocated storage before the scan
 
   fesetround(2); // round UP
   number_of_blocks = lrintl(ceil(filesize*1.0l/512/st->sectors));
 
+  scan_blocks = number_of_blocks;
+  if (st->max_sectors != 0 &&
+      lrintl(ceill(st->max_sectors*1.0L/st->sectors)) < scan_blocks)
+    scan_blocks = lrintl(ceill(st->max_sectors*1.0L/st->sectors));
+
+  if (st->progressive)
+    {
+      // long runs keep the throughput high, 64MiB takes about half a second
+      run_len = 64 * 1024 * 1024 / st->sectors / 512;
+      runs = (scan_blocks + run_len - 1) / run_len;
+      run_order = progressive_order(runs, &stride);
+    }
+  else
+    run_len = scan_blocks;
+  run_end = (run_len < scan_blocks) ? run_len : scan_blocks;
+
   // get memory aligned pointer (needed for O_DIRECT access)
   ibuf = malloc(st->sectors*512+pagesize);
   ibuf_free = ibuf;
@@ -2220,20 +4459,49 @@ read_whole_disk(struct status_t *st, int dev_fd, struct block_info_t* block_info
   read(dev_fd, ibuf, pagesize);
   lseek(dev_fd, (off_t)0, SEEK_SET);
 
-  clock_gettime(TIMER_TYPE, &time2);
+  time2 = timing_now();
   if (dev_stat_path != NULL)
     get_read_writes(dev_stat_path, &read_e, &read_sec_e, &write_e);
 
   clock_gettime(TIMER_TYPE, &times);
+  loop_start = times;
   off_t last_invalid = 0;
-  unsigned int info = 0;
+  faults = page_faults();
+  spills = bi_pool_spills;
+  profile_start(st);
   while (1)
     {
+      // move to the next run in progressive mode
+      if (run_order != NULL && blocks >= run_end)
+        {
+          run++;
+          run_start = run_order[run] * run_len;
+          run_end = run_start + run_len;
+          if (run_end > scan_blocks)
+            run_end = scan_blocks;
+          blocks = run_start;
+          error_streak = 0;
+
+          // read the block before the run to exclude seek time
+          if (!st->ata_verify &&
+              lseek(dev_fd, (off_t)512*st->sectors*(blocks-1), SEEK_SET) < 0)
+            break;
+          read_sectors(st, dev_fd, ibuf, (blocks-1) * st->sectors,
+              st->sectors);
+          // XXX ignore errors
+          if (!st->ata_verify &&
+              lseek(dev_fd, (off_t)512*st->sectors*blocks, SEEK_SET) < 0)
+            break;
+
+          time2 = timing_now();
+          if (dev_stat_path != NULL)
+            get_read_writes(dev_stat_path, &read_e, &read_sec_e, &write_e);
+        }
+
       read_s = read_e;
       write_s = write_e;
       read_sec_s = read_sec_e;
-      time1.tv_sec=time2.tv_sec;
-      time1.tv_nsec=time2.tv_nsec;
+      time1 = time2;
 
       // assertion
       if (!st->ata_verify &&
@@ -2246,45 +4514,44 @@ read_whole_disk(struct status_t *st, int dev_fd, struct block_info_t* block_info
           exit(EXIT_FAILURE);
         }
 
-      //clock_gettime(TIMER_TYPE, &time1);
-      if (!st->ata_verify)
-        nread = read(dev_fd, ibuf, st->sectors*512);
-      else
-        {
-          int_res = sg_ll_verify10(dev_fd, 0, 0, 0,
-                 (unsigned int)(blocks * st->sectors),
-                 st->sectors, NULL, 0, &info, 1, st->verbosity);
-
-          if (int_res != 0)
-            {
-              errno = EIO;
-              nread = -1;
-            }
-          else
-            nread = st->sectors*512;
-
-        }
+      profile_switch(st, PROFILE_IO);
+      nread = read_sectors(st, dev_fd, ibuf, blocks * st->sectors,
+          st->sectors);
+      profile_switch(st, PROFILE_STAT);
 
-      clock_gettime(TIMER_TYPE, &time2);
+      time2 = timing_now();
+      sample = read_elapsed(time1, time2);
 
       if (dev_stat_path != NULL)
         get_read_writes(dev_stat_path, &read_e, &read_sec_e, &write_e);
+      profile_switch(st, PROFILE_ANALYSIS);
 
       if (nread < 0) // on error
         {
-          if (errno != EIO)
+          if (errno != EIO && errno != ETIMEDOUT)
             err(EXIT_FAILURE, NULL);
           else
             {
-              diff_time(&res, time1, time2);
-              nread = 1; // don't exit loop
-              write(2, "E", 1);
-              // make sure the error is saved and reported later
+              update_speed_profile(st, blocks, -1.0);
+              update_heatmap(st, blocks, -1.0);
+              if (errno == ETIMEDOUT)
+                {
+                  write(2, "T", 1);
+                  bi_add_timeout(&block_info[blocks]);
+                  st->tot_timeouts++;
+                  st->timeouts++;
+                }
+              else
+                {
+                  write(2, "E", 1);
+                  bi_add_error(&block_info[blocks]);
+                  st->tot_errors++;
+                  st->errors++;
+                }
+              // make sure the error is saved and reported later (adding
+              // the error initialises the block)
               bi_make_valid(&block_info[blocks]);
-              bi_add_error(&block_info[blocks]);
-
-              st->tot_errors++;
-              st->errors++;
+              nread = 1; // don't exit loop
 
               if (st->bad_sector_warning)
                 {
@@ -2297,6 +4564,30 @@ read_whole_disk(struct status_t *st, int dev_fd, struct block_info_t* block_info
                 {
                   nread = -1; // exit loop, end of device
                 }
+
+              if (error_streak++ == 0)
+                streak_start = blocks;
+
+              // jump over dense error regions, their edges are mapped after
+              // the scan
+              off_t skip = 0;
+              if (st->skip_errors && nread != -1)
+                skip = error_skip_length(st, error_streak,
+                    run_end - blocks - 1);
+              if (skip > 0)
+                {
+                  if (lseek(dev_fd, (off_t)512*st->sectors*skip, SEEK_CUR) < 0)
+                    nread = -1; // exit loop, end of device
+
+                  if (st->verbosity > 1)
+                    printf("skipping %lli blocks after %zi errors%s\n",
+                        (long long)skip, error_streak, CLEAR_LINE_END);
+
+                  blocks += skip;
+                  pos += skip;
+                  add_skipped_region(st, streak_start, blocks + 1);
+                  next_is_valid = 0;
+                }
             }
         }
       // when the read was incomplete or interrupted
@@ -2315,6 +4606,8 @@ read_whole_disk(struct status_t *st, int dev_fd, struct block_info_t* block_info
                 st->nodirect == 0 && dev_stat_path != NULL) ||
           (write_e != write_s && dev_stat_path != NULL))
         {
+          error_streak = 0;
+
           if (st->verbosity > 0)
             printf("block %zi (LBA: %lli-%lli) interrupted%s\n", blocks,
                ((off_t)blocks) * (long long)st->sectors,
@@ -2325,14 +4618,13 @@ read_whole_disk(struct status_t *st, int dev_fd, struct block_info_t* block_info
             st->invalid++;
 
           st->tot_interrupts++;
+          HDCK_PROBE3(interference, blocks, read_e - read_s,
+              write_e - write_s);
 
-          diff_time(&res, time1, time2);
-          times_time(&res, 1000); // in ms not ns
           if (bi_is_valid(&block_info[blocks]) == 0)
             {
-              bi_add_time(&block_info[blocks], time_double(res));
+              bi_add_time(&block_info[blocks], timing_ms(sample));
             }
-          diff_time(&res, time1, time2);
           if (nread != st->sectors*512)
             {
               // seek to start of next block
@@ -2345,9 +4637,12 @@ read_whole_disk(struct status_t *st, int dev_fd, struct block_info_t* block_info
           next_is_valid = 0;
 
           // invalidate last 8 read blocks
-          for(int i=1; blocks > i && i <= 8 && blocks > last_invalid + i; i++)
+          int invalidated = 0;
+          for(int i=1; blocks > i && i <= 8 && blocks > last_invalid + i &&
+              blocks - i >= run_start; i++)
             if (bi_is_valid(&block_info[blocks-i]))
               {
+                invalidated++;
                 remove_block_from_stats(st,
                     bi_quantile(&block_info[blocks-i],9,10));
                 bi_remove_last(&block_info[blocks-i]);
@@ -2358,205 +4653,1811 @@ read_whole_disk(struct status_t *st, int dev_fd, struct block_info_t* block_info
                   st->invalid++;
               }
 
-          last_invalid = blocks;
+          HDCK_PROBE2(invalidate, blocks, invalidated);
+
+          last_invalid = blocks;
+
+          //update_block_stats(st, block_info);
+        }
+      else // when the read was correct
+        {
+          error_streak = 0;
+
+          // reads after seeks or interruptions don't show zone's speed
+          if (next_is_valid == 1)
+            {
+              update_zone_baseline(st, blocks, timing_ms(sample));
+              update_speed_profile(st, blocks, timing_ms(sample));
+              update_heatmap(st, blocks, timing_ms(sample));
+            }
+
+          // update only if we can gather meaningful data
+          if (bi_is_valid(&block_info[blocks]) == 0 ||
+              (bi_is_valid(&block_info[blocks]) && next_is_valid == 1))
+            {
+              if (bi_is_valid(&block_info[blocks]) == 0 && next_is_valid == 1)
+                {
+                  // first valid read
+                  bi_clear(&block_info[blocks]);
+                  add_block(st, &block_info[blocks], timing_ms(sample));
+                  bi_make_valid(&block_info[blocks]);
+                  st->invalid--;
+                  add_block_to_stats(st, timing_ms(sample));
+
+                  if (st->verbosity > 10)
+                    printf("block: %zi, samples: %zi, average: "
+                        "%f, rel stdev: %f, trunc rel stdev: %f%s\n",
+                        blocks,
+                        bi_num_samples(&block_info[blocks]),
+                        bi_average(&block_info[blocks]),
+                        bi_rel_stdev(&block_info[blocks]),
+                        bi_int_rel_stdev(&block_info[blocks]),
+                        CLEAR_LINE_END);
+                }
+              else
+                {
+                  // subsequent valid or invalid reads
+                  add_block(st, &block_info[blocks], timing_ms(sample));
+
+                  if (st->verbosity > 10)
+                    printf("block: %zi, samples: %zi, average: "
+                        "%f, rel stdev: %f, trunc rel stdev: %f%s\n",
+                        blocks,
+                        bi_num_samples(&block_info[blocks]),
+                        bi_average(&block_info[blocks]),
+                        bi_rel_stdev(&block_info[blocks]),
+                        bi_int_rel_stdev(&block_info[blocks]),
+                        CLEAR_LINE_END);
+                }
+            }
+
+          next_is_valid = 1;
+
+          add_sample_to_stats(st, timing_ms(sample));
+        }
+
+      if (st->sector_times == PRINT_TIMES)
+        printf("%lli r:%lli rs: %lli w:%lli%s\n",
+            (long long)(sample / 1000),
+            read_s,
+            read_sec_s,
+            write_s,
+            CLEAR_LINE_END);
+
+      blocks++;
+      pos++;
+      abs_blocks++;
+
+      profile_switch(st, PROFILE_DISPLAY);
+      publish_metrics(st, METRICS_DISPLAY_SCAN, blocks, loop + 1,
+          (st->progressive) ? progressive_pass(run_order[run], stride) + 1 : 0,
+          (st->progressive) ? progressive_pass(1, stride) + 1 : 0,
+          (pos * 1.0 / scan_blocks + loop) / st->min_reads);
+      profile_switch(st, PROFILE_ANALYSIS);
+      profile_block_done(st);
+
+      // on user's request stop right away, in progressive mode only after
+      // the current pass, so that the whole surface is covered evenly
+      if (stop_requested && (run_order == NULL || (blocks >= run_end &&
+              (run + 1 >= runs || progressive_pass(run_order[run + 1], stride)
+               != progressive_pass(run_order[run], stride)))))
+        {
+          if (st->verbosity >= 0)
+            printf("test interrupted, stopping the scan%s\n",
+                CLEAR_LINE_END);
+          if (st->flog != NULL)
+            fprintf(st->flog, "test interrupted, stopping the scan at "
+                "loop %zi, %zi blocks read\n", loop+1, pos);
+          st->deadline_hit = 1;
+
+          // keep samples and duration of the partial loop
+          clock_gettime(TIMER_TYPE, &timee);
+          diff_time(&res, loop_start, timee);
+          add_loop_time(st, time_double(res));
+
+          update_block_stats(st, block_info);
+          break;
+        }
+
+      // leave time for re-reads before the deadline
+      if (!stop_requested && st->deadline.tv_sec != 0 && pos % 64 == 0 &&
+          time_left(st) <= st->deadline_reserve)
+        {
+          if (st->verbosity >= 0)
+            printf("deadline approaching, stopping the scan%s\n",
+                CLEAR_LINE_END);
+          if (st->flog != NULL)
+            fprintf(st->flog, "deadline approaching, stopping the scan at "
+                "loop %zi, %zi blocks read\n", loop+1, pos);
+          st->deadline_hit = 1;
+
+          // keep samples and duration of the partial loop
+          clock_gettime(TIMER_TYPE, &timee);
+          diff_time(&res, loop_start, timee);
+          add_loop_time(st, time_double(res));
+
+          update_block_stats(st, block_info);
+          break;
+        }
+
+      // check whether we have to leave the loop
+      if (nread == 0 || nread == -1 || pos >= scan_blocks)
+        {
+          long long high_dev=0;
+          long long sum_invalid=0;
+          loop++;
+
+          clock_gettime(TIMER_TYPE, &timee);
+          diff_time(&res, loop_start, timee);
+          add_loop_time(st, time_double(res));
+
+          update_block_stats(st, block_info);
+
+          // check standard deviation for blocks
+          for (size_t i =0; i < pos; i++)
+            {
+              if (bi_int_rel_stdev(&block_info[i]) > st->max_std_dev)
+                high_dev++;
+
+              // blocks skipped because of read errors weren't read at all
+              if (bi_is_valid(&block_info[i]) == 0 &&
+                  bi_is_initialised(&block_info[i]))
+                sum_invalid++;
+            }
+          if (loop < st->min_reads ||
+              high_dev/(pos*1.0) > 0.25 ||
+              sum_invalid/(pos*1.0) > 0.10)
+            {
+              if (
+                  st->verbosity >= 0 &&
+                  !(loop < st->min_reads) &&
+                  ( high_dev/(pos*1.0) > 0.25
+                    || sum_invalid/(pos*1.0) > 0.10)
+                 )
+                printf("low confidance for the results, "
+                    "re-reading whole disk%s\n", CLEAR_LINE_END);
+
+              // don't start a loop that won't finish before the deadline
+              clock_gettime(TIMER_TYPE, &timee);
+              diff_time(&res, loop_start, timee);
+              if (time_left(st) - st->deadline_reserve < time_double(res))
+                {
+                  if (st->verbosity >= 0)
+                    printf("not enough time left for another loop%s\n",
+                        CLEAR_LINE_END);
+                  if (st->flog != NULL)
+                    fprintf(st->flog, "not enough time left for another "
+                        "loop, stopping after %zi loops\n", loop);
+                  st->deadline_hit = 1;
+                  break;
+                }
+              loop_start = timee;
+
+              blocks=0;
+              pos=0;
+              run=0;
+              error_streak = 0;
+              run_start=0;
+              run_end = (run_len < scan_blocks) ? run_len : scan_blocks;
+              // seek to first block
+              if (lseek(dev_fd, (off_t)0, SEEK_SET) < 0)
+                {
+                  nread = -1; // exit loop, end of device
+                }
+              // try to place first sector in cache
+              if (!st->ata_verify)
+                {
+                  nread = read_timeout(st, dev_fd, ibuf, 512);
+                  if (lseek(dev_fd, (off_t)0, SEEK_SET) < 0)
+                    {
+                      nread = -1; // exit loop, end of device
+                    }
+                }
+              time2 = timing_now();
+              // TODO: flush system buffers when no direct
+            }
+          else
+            break;
+
+          if (loop > st->max_reads + st->min_reads)
+            {
+              printf("Warning: read whole disk %zi times, still "
+                  "can't get high confidence%s\n", st->max_reads,
+                  CLEAR_LINE_END);
+              break;
+            }
+        }
+    }
+
+  st->scan_faults += page_faults() - faults;
+  st->scan_spills += bi_pool_spills - spills;
+
+  // don't redraw the status over messages printed after the scan
+  set_metrics_phase(st, st->phase);
+
+ free(ibuf_free);
+ free(run_order);
+}
+
+/**
+ * classify disk condition based on block statistics
+ *
+ * @param[out] desc description of the condition, NULL if there is none
+ * @return name of the condition
+ */
+const char*
+get_disk_status(struct status_t *st, const char **desc)
+{
+  *desc = NULL;
+
+  if (st->errors != 0)
+    {
+      *desc = "CAUTION! Bad sectors detected, copy data off this "
+          "disk AS SOON AS POSSIBLE!";
+      return "FAILED";
+    }
+  else if (st->timeouts != 0)
+    {
+      *desc = "CAUTION! Reads that didn't complete in time detected, "
+          "drive may be ALREADY FAILING!";
+      return "CRITICAL";
+    }
+  else if (st->vvslow != 0)
+    {
+      *desc = "CAUTION! Sectors that required more than 6 read "
+          "attempts detected, drive may be ALREADY FAILING!";
+      return "CRITICAL";
+    }
+  else if (st->vslow != 0)
+    {
+      *desc = "sectors that required more than 4 read attempts "
+          "detected!";
+      return "very bad";
+    }
+  else if (st->slow != 0)
+    {
+      *desc = "sectors that required more than 2 read attempts "
+          "detected";
+      if (!st->quick || st->exclusive)
+        return "bad";
+      else
+        return "moderate";
+    }
+  else if (((st->normal * 1.0) / (st->number_of_blocks * 1.0) > 0.001
+              && !st->quick)
+      || ((st->normal * 1.0) / (st->number_of_blocks * 1.0) > 0.25
+          && st->quick))
+    {
+      *desc = "high number of blocks that required more than 1 "
+          "read attempt detected";
+      return "moderate";
+    }
+  else if (st->normal == 0)
+    {
+      if ((st->fast * 1.0) / (st->number_of_blocks * 1.0) < 0.1)
+        return "excellent";
+
+      *desc = "no blocks that required constant re-reads detected";
+      return "very good";
+    }
+
+  *desc = "few blocks that required more than 1 read attempt detected";
+  return "good";
+}
+
+/**
+ * return random block number lower than max
+ */
+off_t
+random_block(off_t max)
+{
+  uint64_t r;
+
+  r = ((uint64_t)random() << 31) ^ (uint64_t)random();
+
+  return r % max;
+}
+
+/**
+ * read stratified random sample of blocks from the device
+ *
+ * Device is divided into equally sized strata, a block is selected at random
+ * from every one of them
+ *
+ * @param fraction fraction of blocks to read, 0 if duration is used
+ * @param duration for how long (in seconds) to sample, 0 if fraction is used
+ */
+void
+read_sample(struct status_t *st, int dev_fd, struct block_info_t *block_info,
+    char *dev_stat_path, double fraction, double duration)
+{
+  struct block_ranges_t block_list;
+  struct timespec time_start, time_now, res;
+  off_t strata;
+  off_t number_of_blocks = st->number_of_blocks;
+
+  if (fraction > 0)
+    strata = ceil(number_of_blocks * fraction);
+  else
+    strata = 1024;
+
+  if (strata > number_of_blocks)
+    strata = number_of_blocks;
+  if (strata < 1)
+    strata = 1;
+
+  br_init(&block_list);
+
+  srandom(time(NULL) ^ getpid());
+
+  clock_gettime(TIMER_TYPE, &time_start);
+
+  while (1)
+    {
+      br_clear(&block_list);
+      for (off_t i=0; i < strata; i++)
+        {
+          off_t start = number_of_blocks * i / strata;
+          off_t end = number_of_blocks * (i + 1) / strata;
+
+          br_add(&block_list, start + random_block(end - start), 1);
+        }
+
+      read_block_list(st, dev_fd, &block_list, block_info, dev_stat_path,
+          number_of_blocks);
+
+      if (fraction > 0)
+        break;
+
+      clock_gettime(TIMER_TYPE, &time_now);
+      diff_time(&res, time_start, time_now);
+      if (time_double(res) >= duration)
+        break;
+    }
+
+  br_free(&block_list);
+}
+
+/**
+ * Wilson score interval for proportion of successes in Bernoulli trials
+ *
+ * @param successes number of successes
+ * @param trials number of trials, has to be positive
+ * @param z quantile of normal distribution for the confidence level
+ * @param low lower bound of the interval, returned
+ * @param high upper bound of the interval, returned
+ */
+static void
+wilson_interval(long long successes, long long trials, double z,
+    double *low, double *high)
+{
+  double p = successes * 1.0 / trials;
+  double n = trials;
+  double denom = 1 + z * z / n;
+  double center = (p + z * z / (2 * n)) / denom;
+  double half = z * sqrt(p * (1 - p) / n + z * z / (4 * n * n)) / denom;
+
+  *low = (center - half < 0) ? 0 : center - half;
+  *high = (center + half > 1) ? 1 : center + half;
+}
+
+/**
+ * print estimate of disk condition based on sampled blocks
+ */
+void
+print_sample_estimate(struct status_t *st, struct block_info_t *block_info,
+    struct timespec elapsed)
+{
+  long long counts[8] = {0};
+  const char *names[8] = {"ERR    ", NULL, NULL, NULL, NULL, NULL, NULL,
+    NULL};
+  double levels[7] = {st->vvfast_lvl, st->vfast_lvl, st->fast_lvl,
+    st->normal_lvl, st->slow_lvl, st->vslow_lvl, st->vslow_lvl};
+  long long sampled = 0;
+  const double z = 1.96; // 95% confidence
+  off_t total = st->number_of_blocks;
+  struct status_t est;
+
+  for (size_t i=0; i < st->number_of_blocks; i++)
+    {
+      if (!bi_is_initialised(&block_info[i]))
+        continue;
+
+      if (bi_get_error(&block_info[i]) || bi_get_timeout(&block_info[i]))
+        {
+          counts[0]++;
+          sampled++;
+          continue;
+        }
+
+      if (!bi_is_valid(&block_info[i]) || bi_num_samples(&block_info[i]) == 0)
+        continue;
+
+      double decile = bi_quantile(&block_info[i], 9, 10);
+      int bucket;
+      for (bucket = 0; bucket < 6; bucket++)
+        if (decile < levels[bucket])
+          break;
+
+      counts[bucket+1]++;
+      sampled++;
+    }
+
+  if (st->verbosity >= 0)
+    printf("%s\nhdck sample estimate:%s\n"
+        "=====================%s\n", CLEAR_LINE, CLEAR_LINE_END,
+        CLEAR_LINE_END);
+  if (st->flog != NULL)
+    fprintf(st->flog, "sample estimate:\n");
+
+  if (sampled == 0)
+    {
+      printf("no blocks could be sampled\n");
+      if (st->flog != NULL)
+        fprintf(st->flog, "no blocks could be sampled\n");
+      return;
+    }
+
+  if (st->verbosity >= 0)
+    printf("sampled %lli of %lli blocks (%.2f%%) in %02li:%02li:%02li%s\n",
+        sampled, (long long)total, sampled * 100.0 / total,
+        elapsed.tv_sec/3600, elapsed.tv_sec/60%60, elapsed.tv_sec%60,
+        CLEAR_LINE_END);
+  if (st->flog != NULL)
+    fprintf(st->flog, "sampled %lli of %lli blocks (%.2f%%) in "
+        "%02li:%02li:%02li\n",
+        sampled, (long long)total, sampled * 100.0 / total,
+        elapsed.tv_sec/3600, elapsed.tv_sec/60%60, elapsed.tv_sec%60);
+
+  if (st->verbosity >= 0)
+    printf("         Sampled:    Estimated blocks:   95%% confidence "
+        "interval:%s\n", CLEAR_LINE_END);
+  if (st->flog != NULL)
+    fprintf(st->flog, "         Sampled:    Estimated blocks:   95%% "
+        "confidence interval:\n");
+
+  est = *st;
+  long long *est_counts[8] = {&est.errors, &est.vvfast, &est.vfast,
+    &est.fast, &est.normal, &est.slow, &est.vslow, &est.vvslow};
+
+  for (int i=0; i < 8; i++)
+    {
+      double p = counts[i] * 1.0 / sampled;
+      double low, high;
+      char name[16];
+
+      wilson_interval(counts[i], sampled, z, &low, &high);
+
+      if (names[i] != NULL)
+        snprintf(name, sizeof(name), "%s", names[i]);
+      else
+        snprintf(name, sizeof(name), "%c%4.1fms", (i == 7) ? '>' : '<',
+            levels[i-1]);
+
+      *est_counts[i] = llround(p * total);
+      // a single sampled block is enough to change the verdict
+      if (counts[i] != 0 && *est_counts[i] == 0)
+        *est_counts[i] = 1;
+
+      if (st->verbosity >= 0)
+        printf("%s: %10lli %20lli %12lli - %-12lli%s\n", name, counts[i],
+            *est_counts[i], llround(low * total), llround(high * total),
+            CLEAR_LINE_END);
+      if (st->flog != NULL)
+        fprintf(st->flog, "%s: %10lli %20lli %12lli - %-12lli\n", name,
+            counts[i], *est_counts[i], llround(low * total),
+            llround(high * total));
+    }
+
+  const char *status, *status_desc;
+
+  status = get_disk_status(&est, &status_desc);
+
+  printf("\nEstimated disk status: %s\n", status);
+  if (status_desc != NULL)
+    printf("%s\n", status_desc);
+
+  if (st->flog != NULL)
+    {
+      fprintf(st->flog, "\nEstimated disk status: %s\n", status);
+      if (status_desc != NULL)
+        fprintf(st->flog, "%s\n", status_desc);
+    }
+}
+
+/// number of requests kept in flight by scan_errors()
+#define ERRORS_QUEUE_DEPTH 4
+/// size of single read in scan_errors(), in blocks (4MiB)
+#define ERRORS_READ_BLOCKS 32
+
+/**
+ * check if sectors can be read
+ *
+ * @param buffer aligned buffer big enough to hold count sectors
+ * @param sector first sector (512 byte) to check
+ * @param count number of sectors to check
+ * @return 0 if the range is readable, -1 otherwise, with errno set to
+ * ETIMEDOUT if the read didn't finish in time
+ */
+static int
+check_sectors(struct status_t *st, int fd, char *buffer, off_t sector,
+    off_t count)
+{
+  ssize_t nread;
+
+  if (st->ata_verify)
+    nread = read_sectors(st, fd, buffer, sector, count);
+  else
+    nread = pread_timeout(st, fd, buffer, count * 512, sector * 512);
+
+  if (nread < 0 && errno != EIO && errno != ETIMEDOUT)
+    err(EXIT_FAILURE, "check_sectors");
+  if (nread != count * 512)
+    {
+      if (nread >= 0)
+        errno = EIO;
+      return -1;
+    }
+  return 0;
+}
+
+/**
+ * add sector range to the list of bad ranges, merging it with the last one
+ * if they are adjacent
+ */
+static void
+add_bad_range(struct extent_list_t *bad, off_t sector, off_t count)
+{
+  if (bad->len > 0 &&
+      bad->list[bad->len-1].off + bad->list[bad->len-1].len == sector)
+    {
+      bad->list[bad->len-1].len += count;
+      return;
+    }
+
+  if (bad->len + 1 >= bad->alloc)
+    {
+      bad->alloc = (bad->alloc) ? bad->alloc * 2 : 64;
+      bad->list = realloc(bad->list, sizeof(struct block_list_t) * bad->alloc);
+      if (bad->list == NULL)
+        err(EXIT_FAILURE, "add_bad_range");
+    }
+  bad->list[bad->len].off = sector;
+  bad->list[bad->len].len = count;
+  bad->len++;
+}
+
+/**
+ * find unreadable sectors in a range that failed to read
+ *
+ * Range is split in half recursively, halves that read correctly are
+ * skipped, until single logical sectors are left
+ *
+ * @param unit size of logical sector, in 512 byte sectors
+ * @param timed_out whether the failed read of the range timed out
+ */
+static void
+bisect_errors(struct status_t *st, int fd, char *buffer,
+    struct block_info_t *block_info, struct extent_list_t *bad,
+    off_t sector, off_t count, off_t unit, int timed_out)
+{
+  off_t half;
+
+  if (count <= unit)
+    {
+      if (st->verbosity > 1)
+        printf("\r%s sector %lli%s\n",
+            (timed_out) ? "timed out" : "unreadable", (long long)sector,
+            CLEAR_LINE_END);
+      if (st->flog != NULL)
+        fprintf(st->flog, "%s sector %lli\n",
+            (timed_out) ? "timed out" : "unreadable", (long long)sector);
+
+      add_bad_range(bad, sector, count);
+      // st->errors and st->timeouts count blocks, tot_* count sectors here
+      struct block_info_t *bi = &block_info[sector / st->sectors];
+      if (timed_out)
+        {
+          if (bi_get_timeout(bi) == 0)
+            st->timeouts++;
+          bi_add_timeout(bi);
+          st->tot_timeouts++;
+        }
+      else
+        {
+          if (bi_get_error(bi) == 0)
+            st->errors++;
+          bi_add_error(bi);
+          st->tot_errors++;
+        }
+      return;
+    }
+
+  // split on logical sector boundary
+  half = count / unit / 2 * unit;
+
+  if (check_sectors(st, fd, buffer, sector, half) != 0)
+    bisect_errors(st, fd, buffer, block_info, bad, sector, half, unit,
+        errno == ETIMEDOUT);
+  if (check_sectors(st, fd, buffer, sector + half, count - half) != 0)
+    bisect_errors(st, fd, buffer, block_info, bad, sector + half,
+        count - half, unit, errno == ETIMEDOUT);
+}
+
+/**
+ * scan the device for unreadable sectors only
+ *
+ * Device is read in big chunks with few requests in flight (or verified
+ * with ATA VERIFY), without timing individual blocks. Chunks that fail are
+ * bisected down to single logical sectors.
+ *
+ * @return list of unreadable sector ranges, in 512 byte sectors, or NULL if
+ * none were found
+ */
+struct block_list_t*
+scan_errors(struct status_t *st, int dev_fd, struct block_info_t *block_info)
+{
+  struct aiocb *cb[ERRORS_QUEUE_DEPTH];
+  int fds[ERRORS_QUEUE_DEPTH];
+  char *buffers[ERRORS_QUEUE_DEPTH];
+  off_t chunk = (off_t)ERRORS_READ_BLOCKS * st->sectors; ///< in sectors
+  off_t total = st->number_of_blocks * st->sectors; ///< in sectors
+  off_t next = 0; ///< next sector to submit
+  off_t done = 0; ///< sectors checked
+  int logical_size = 512;
+  off_t unit;
+  size_t submitted = 0, completed = 0;
+  struct extent_list_t bad = { 0 };
+  struct timespec time_start, time_now, res;
+
+  if (ioctl(dev_fd, BLKSSZGET, &logical_size) == -1 || logical_size < 512)
+    logical_size = 512;
+  unit = logical_size / 512;
+
+  for (size_t i=0; i < ERRORS_QUEUE_DEPTH; i++)
+    {
+      // glibc executes requests for single descriptor one after another
+      fds[i] = dup(dev_fd);
+      if (fds[i] < 0)
+        err(EXIT_FAILURE, "scan_errors: dup");
+      cb[i] = calloc(1, sizeof(struct aiocb));
+      if (cb[i] == NULL)
+        err(EXIT_FAILURE, "scan_errors");
+      if (posix_memalign((void **)&buffers[i], pagesize, chunk * 512) != 0)
+        err(EXIT_FAILURE, "scan_errors");
+    }
+
+  clock_gettime(TIMER_TYPE, &time_start);
+
+  while (done < total)
+    {
+      // keep the queue full
+      while (!st->ata_verify && next < total &&
+          submitted - completed < ERRORS_QUEUE_DEPTH && time_left(st) > 0)
+        {
+          struct aiocb *c = cb[submitted % ERRORS_QUEUE_DEPTH];
+          off_t len = (total - next < chunk) ? total - next : chunk;
+
+          c->aio_fildes = fds[submitted % ERRORS_QUEUE_DEPTH];
+          c->aio_buf = buffers[submitted % ERRORS_QUEUE_DEPTH];
+          c->aio_nbytes = len * 512;
+          c->aio_offset = next * 512;
+          if (aio_read(c) != 0)
+            err(EXIT_FAILURE, "scan_errors: aio_read");
+
+          next += len;
+          submitted++;
+        }
+
+      off_t off = done;
+      off_t len = (total - done < chunk) ? total - done : chunk;
+      size_t slot = completed % ERRORS_QUEUE_DEPTH;
+      int failed;
+      int timed_out = 0;
+
+      if (st->ata_verify)
+        {
+          if (time_left(st) <= 0)
+            {
+              st->deadline_hit = 1;
+              break;
+            }
+          failed = check_sectors(st, dev_fd, buffers[slot], off, len);
+          timed_out = (failed && errno == ETIMEDOUT);
+        }
+      else
+        {
+          if (completed == submitted)
+            {
+              // nothing in flight and nothing could be submitted
+              st->deadline_hit = 1;
+              break;
+            }
+
+          // requests complete in order of submission for the caller
+          struct aiocb *c = cb[slot];
+          if (aio_wait(c, st->timeout) != 0)
+            {
+              // give the request's resources away, take new ones
+              abandon_read(c, buffers[slot]);
+              fds[slot] = dup(dev_fd);
+              if (fds[slot] < 0)
+                err(EXIT_FAILURE, "scan_errors: dup");
+              cb[slot] = calloc(1, sizeof(struct aiocb));
+              if (cb[slot] == NULL)
+                err(EXIT_FAILURE, "scan_errors");
+              if (posix_memalign((void **)&buffers[slot], pagesize,
+                    chunk * 512) != 0)
+                err(EXIT_FAILURE, "scan_errors");
+              failed = 1;
+              timed_out = 1;
+            }
+          else
+            {
+              int error = aio_error(c);
+              ssize_t nread = aio_return(c);
+              if (error != 0 && error != EIO)
+                {
+                  errno = error;
+                  err(EXIT_FAILURE, "scan_errors");
+                }
+              failed = (nread != len * 512);
+            }
+          completed++;
+        }
+
+      if (failed)
+        bisect_errors(st, dev_fd, buffers[slot], block_info, &bad, off, len,
+            unit, timed_out);
+
+      done += len;
+
+      // print statistics
+      if (st->verbosity >= 0 &&
+          (done % (chunk * 16) == 0 || done == total))
+        {
+          clock_gettime(TIMER_TYPE, &time_now);
+          diff_time(&res, time_start, time_now);
+
+          printf("\rerrors-only scan %.2f%% done in %02li:%02li:%02li, "
+              "%.1fMiB/s, unreadable sectors: %lli, timeouts: %lli%s",
+              done * 100.0 / total,
+              res.tv_sec/3600, res.tv_sec/60%60, res.tv_sec%60,
+              done / 2048.0 / time_double(res),
+              st->tot_errors, st->tot_timeouts,
+              CLEAR_LINE_END);
+          fflush(stdout);
+        }
+    }
+
+  // wait for requests left in flight because of deadline
+  for (; completed < submitted; completed++)
+    {
+      size_t slot = completed % ERRORS_QUEUE_DEPTH;
+      if (aio_wait(cb[slot], st->timeout) != 0)
+        {
+          abandon_read(cb[slot], buffers[slot]);
+          cb[slot] = NULL;
+          buffers[slot] = NULL;
+          fds[slot] = -1;
+        }
+      else
+        aio_return(cb[slot]);
+    }
+
+  for (size_t i=0; i < ERRORS_QUEUE_DEPTH; i++)
+    {
+      if (fds[i] >= 0)
+        close(fds[i]);
+      free(cb[i]);
+      free(buffers[i]);
+    }
+
+  if (st->verbosity >= 0)
+    printf("\n");
+
+  if (st->flog != NULL)
+    fprintf(st->flog, "errors-only scan checked %lli of %lli sectors, "
+        "found %lli unreadable, %lli timed out\n", (long long)done,
+        (long long)total, st->tot_errors, st->tot_timeouts);
+
+  if (bad.len == 0)
+    return NULL;
+
+  bad.list[bad.len].off = 0;
+  bad.list[bad.len].len = 0;
+
+  return bad.list;
+}
+
+/**
+ * find edges of regions skipped because of read errors
+ *
+ * Unread blocks in every region are checked (untimed) from both ends until
+ * an unreadable block is found, blocks found readable are then read again
+ * with timing. What stays unread is presumed bad and left in st->skipped,
+ * what the deadline didn't leave time to check is left in st->unscanned.
+ */
+void
+map_skipped_regions(struct status_t *st, int dev_fd,
+    struct block_info_t *block_info)
+{
+  struct block_ranges_t regions = st->skipped;
+  struct block_ranges_t readable;
+  char *buffer;
+
+  if (regions.len == 0)
+    return;
+
+  br_sort(&regions);
+  br_init(&readable);
+
+  if (posix_memalign((void **)&buffer, pagesize, st->sectors * 512) != 0)
+    err(EXIT_FAILURE, "map_skipped_regions");
+
+  br_init(&st->skipped);
+
+  for (size_t i=0; i < regions.len; i++)
+    {
+      off_t end = (off_t)regions.ranges[i].off + regions.ranges[i].len;
+
+      for (off_t start = regions.ranges[i].off; start < end; start++)
+        {
+          off_t first, last;
+
+          if (bi_is_initialised(&block_info[start]))
+            continue;
+
+          // find the run of blocks not read yet
+          last = start;
+          while (last < end && !bi_is_initialised(&block_info[last]))
+            last++;
+
+          // trim from both ends, so that the region's edges are exact
+          // even when it's skipped in the middle
+          off_t lo = last, hi = last;
+          int unchecked = 0; ///< deadline stopped the trimming
+          for (first = start; first < last; first++)
+            {
+              if (time_left(st) <= 0)
+                {
+                  st->deadline_hit = 1;
+                  unchecked = 1;
+                  lo = first;
+                  break;
+                }
+              if (check_sectors(st, dev_fd, buffer, first * st->sectors,
+                    st->sectors) != 0)
+                {
+                  // mark the edge as erroneous, like read_whole_disk() does
+                  bi_make_valid(&block_info[first]);
+                  if (errno == ETIMEDOUT)
+                    {
+                      bi_add_timeout(&block_info[first]);
+                      st->timeouts++;
+                      st->tot_timeouts++;
+                    }
+                  else
+                    {
+                      bi_add_error(&block_info[first]);
+                      st->errors++;
+                      st->tot_errors++;
+                    }
+                  lo = first + 1;
+                  break;
+                }
+              br_add(&readable, first, 1);
+            }
+          while (lo > first && hi > lo)
+            {
+              if (time_left(st) <= 0)
+                {
+                  st->deadline_hit = 1;
+                  unchecked = 1;
+                  break;
+                }
+              if (check_sectors(st, dev_fd, buffer, (hi-1) * st->sectors,
+                    st->sectors) != 0)
+                {
+                  bi_make_valid(&block_info[hi-1]);
+                  if (errno == ETIMEDOUT)
+                    {
+                      bi_add_timeout(&block_info[hi-1]);
+                      st->timeouts++;
+                      st->tot_timeouts++;
+                    }
+                  else
+                    {
+                      bi_add_error(&block_info[hi-1]);
+                      st->errors++;
+                      st->tot_errors++;
+                    }
+                  hi--;
+                  break;
+                }
+              br_add(&readable, hi - 1, 1);
+              hi--;
+            }
+
+          // nothing is known about blocks the deadline didn't leave time
+          // for, what's left between the found edges is presumed bad,
+          // together with the unreadable blocks around it
+          if (hi > lo && unchecked)
+            br_add(&st->unscanned, lo, hi - lo);
+          else if (hi > lo)
+            {
+              while (lo > 0 &&
+                  bi_get_error(&block_info[lo-1]) != 0 &&
+                  bi_num_samples(&block_info[lo-1]) == 0)
+                lo--;
+              while (hi < st->number_of_blocks &&
+                  bi_get_error(&block_info[hi]) != 0 &&
+                  bi_num_samples(&block_info[hi]) == 0)
+                hi++;
+              add_skipped_region(st, lo, hi);
+            }
+
+          start = last;
+        }
+    }
+
+  if (st->verbosity > 1)
+    printf("%zi readable blocks found in regions with read errors%s\n",
+        readable.len, CLEAR_LINE_END);
+  if (st->flog != NULL)
+    fprintf(st->flog, "mapping regions with read errors found %zi readable "
+        "blocks, %zi regions left unread, %zi not checked\n", readable.len,
+        st->skipped.len, st->unscanned.len);
+
+  if (readable.len > 0)
+    {
+      br_sort(&readable);
+
+      read_block_list(st, dev_fd, &readable, block_info, st->dev_stat_path,
+          st->number_of_blocks);
+    }
+
+  free(buffer);
+  br_free(&readable);
+  br_free(&regions);
+}
+
+/// number of reads a block is split into when probing around suspect blocks
+#define EXPAND_PROBE_PARTS 8
+
+/**
+ * check if block lies in a region skipped because of read errors
+ */
+static int
+is_skipped(struct status_t *st, off_t block)
+{
+  for (size_t i=0; i < st->skipped.len; i++)
+    if (block >= st->skipped.ranges[i].off &&
+        block < (off_t)st->skipped.ranges[i].off + st->skipped.ranges[i].len)
+      return 1;
+  return 0;
+}
+
+/**
+ * read block in EXPAND_PROBE_PARTS parts, recording parts that are
+ * unreadable or need more than two read attempts
+ *
+ * @param damaged list of damaged sector ranges to extend
+ * @return 1 if any part of the block is damaged, 0 otherwise
+ */
+static int
+probe_block(struct status_t *st, int fd, char *buffer,
+    struct block_info_t *block_info, struct extent_list_t *damaged,
+    off_t block)
+{
+  off_t part = st->sectors / EXPAND_PROBE_PARTS;
+  int64_t time_start, time_end; ///< start and end of part read, in ns
+  double time; ///< time it took to read the part, in ms
+  int ret = 0;
+
+  // probes follow a seek, read the sectors in front of the block untimed
+  // so that the seek isn't counted in time of the first part, like
+  // zoom_read() does
+  if (block > 0)
+    {
+      check_sectors(st, fd, buffer, block * st->sectors - part, part);
+      // XXX ignore errors
+    }
+
+  for (size_t i=0; i < EXPAND_PROBE_PARTS; i++)
+    {
+      off_t sector = block * st->sectors + i * part;
+      int failed;
+
+      time_start = timing_now();
+      failed = check_sectors(st, fd, buffer, sector, part);
+      time_end = timing_now();
+
+      time = timing_ms(read_elapsed(time_start, time_end));
+
+      if (failed)
+        {
+          if (errno == ETIMEDOUT)
+            {
+              bi_add_timeout(&block_info[block]);
+              st->timeouts++;
+              st->tot_timeouts++;
+            }
+          else
+            {
+              bi_add_error(&block_info[block]);
+              st->errors++;
+              st->tot_errors++;
+            }
+          bi_make_valid(&block_info[block]);
+        }
+      // a part takes as long as slow block only with re-reads
+      else if (time < st->normal_lvl)
+        continue;
+
+      if (st->verbosity > 1)
+        printf("%s sectors LBA: %lli-%lli%s\n",
+            (failed) ? "unreadable" : "slow", (long long)sector,
+            (long long)(sector + part - 1), CLEAR_LINE_END);
+      if (st->flog != NULL)
+        fprintf(st->flog, "%s sectors LBA: %lli-%lli\n",
+            (failed) ? "unreadable" : "slow", (long long)sector,
+            (long long)(sector + part - 1));
+
+      add_bad_range(damaged, sector, part);
+      ret = 1;
+    }
+
+  return ret;
+}
+
+/**
+ * map damaged areas around slow and unreadable blocks
+ *
+ * Errors cluster, so neighbours of every suspect block are probed in smaller
+ * reads, moving further away in both directions for as long as the probed
+ * blocks are damaged too. Probed blocks are then read again with timing to
+ * get additional samples for them. Damaged sector ranges are left in
+ * st->damaged.
+ */
+void
+expand_suspect_blocks(struct status_t *st, int dev_fd,
+    struct block_info_t *block_info)
+{
+  struct extent_list_t damaged;
+  struct block_ranges_t resample;
+  struct block_ranges_t probed; ///< blocks already probed, sorted
+  size_t suspects = 0;
+  char *buffer;
+
+  memset(&damaged, 0, sizeof(struct extent_list_t));
+  damaged.st = st;
+
+  br_init(&probed);
+  br_init(&resample);
+  if (posix_memalign((void **)&buffer, pagesize,
+        st->sectors / EXPAND_PROBE_PARTS * 512) != 0)
+    err(EXIT_FAILURE, "expand_suspect_blocks");
+
+  for (off_t block=0; block < st->number_of_blocks; block++)
+    {
+      struct block_info_t *bi = &block_info[block];
+
+      if (!bi_is_initialised(bi) || is_skipped(st, block))
+        continue;
+
+      if (bi_get_error(bi) == 0 && bi_get_timeout(bi) == 0 &&
+          (!bi_is_valid(bi) || bi_num_samples(bi) == 0 ||
+           bi_quantile(bi, 9, 10) < st->normal_lvl))
+        continue;
+
+      suspects++;
+
+      if (!br_contains(&probed, block))
+        {
+          if (time_left(st) <= 0)
+            {
+              st->deadline_hit = 1;
+              break;
+            }
+          br_insert(&probed, block);
+          probe_block(st, dev_fd, buffer, block_info, &damaged, block);
+        }
+
+      for (int direction = -1; direction <= 1; direction += 2)
+        {
+          for (off_t n = block + direction;
+              n >= 0 && n < st->number_of_blocks; n += direction)
+            {
+              // already mapped when probing around other suspect block
+              if (br_contains(&probed, n) || is_skipped(st, n))
+                break;
+
+              if (time_left(st) <= 0)
+                {
+                  st->deadline_hit = 1;
+                  break;
+                }
+
+              br_insert(&probed, n);
+              br_add(&resample, n, 1);
+
+              if (!probe_block(st, dev_fd, buffer, block_info, &damaged, n))
+                break;
+            }
+        }
+    }
+
+  if (st->verbosity > 1)
+    printf("probed %zi neighbours of %zi suspect blocks%s\n", resample.len,
+        suspects, CLEAR_LINE_END);
+  if (st->flog != NULL)
+    fprintf(st->flog, "probed %zi neighbours of %zi suspect blocks\n",
+        resample.len, suspects);
+
+  if (resample.len > 0 && !st->deadline_hit)
+    {
+      br_sort(&resample);
+
+      read_block_list(st, dev_fd, &resample, block_info, st->dev_stat_path,
+          st->number_of_blocks);
+    }
+
+  // probes around different blocks may be out of order, merge them
+  if (damaged.len > 0)
+    {
+      size_t len = 0;
+
+      qsort(damaged.list, damaged.len, sizeof(struct block_list_t),
+          __off_t_compare);
+      for (size_t i=1; i < damaged.len; i++)
+        {
+          if (damaged.list[len].off + damaged.list[len].len >=
+              damaged.list[i].off)
+            {
+              off_t end = damaged.list[i].off + damaged.list[i].len;
+              if (end > damaged.list[len].off + damaged.list[len].len)
+                damaged.list[len].len = end - damaged.list[len].off;
+            }
+          else
+            damaged.list[++len] = damaged.list[i];
+        }
+      damaged.len = len + 1;
+    }
+
+  st->damaged = damaged.list;
+  st->damaged_len = damaged.len;
+
+  free(buffer);
+  br_free(&resample);
+  br_free(&probed);
+}
+
+/**
+ * set block time thresholds based on rotational delay of the disk
+ */
+void
+set_block_thresholds(struct status_t *st)
+{
+  double baseline = st->rotational_delay / BLOCK_READS_PER_REVOLUTION;
+
+  st->vvfast_lvl = baseline * 1.5;
+  // sectors that include cylinder change take twice as long as the normal
+  // read, but definitely are not re-reads
+  st->vfast_lvl = baseline + st->rotational_delay / 2;
+  // ones that needed one re-read
+  st->fast_lvl = baseline + st->rotational_delay * 1.5;
+  // at most two re-reads
+  st->normal_lvl = baseline + st->rotational_delay * 2.5;
+  // four at most
+  st->slow_lvl = baseline + st->rotational_delay * 4.5;
+  // six at most
+  st->vslow_lvl = baseline + st->rotational_delay * 6.5;
+}
+
+/// number of places on disk where rotational delay is measured
+#define CALIBRATE_POSITIONS 8
+/// number of backward steps made at every place
+#define CALIBRATE_STEPS 8
+/// largest disk cache size checked, in MiB
+#define CALIBRATE_MAX_CACHE 256
+
+/**
+ * measure time of single revolution of the platters
+ *
+ * Reading a sector right before the one that was just read has to wait for
+ * the platter to make (almost) full revolution, so time of such reads is
+ * the rotational delay. The steps have to be whole physical sectors, a
+ * logical sector sharing physical sector with the one just read comes from
+ * the disk buffer.
+ *
+ * @param unit size of physical sector, in 512 byte sectors
+ * @return rotational delay in ms
+ */
+static double
+measure_rotational_delay(struct status_t *st, int fd, char *buffer,
+    off_t unit)
+{
+  struct block_info_t times;
+  int64_t time_start, time_end; ///< start and end of read, in ns
+  off_t disk_sectors = st->number_of_blocks * st->sectors;
+  double ret;
+
+  bi_init(&times);
+  bi_make_valid(&times);
+
+  for (size_t i=0; i < CALIBRATE_POSITIONS; i++)
+    {
+      off_t sector = disk_sectors / CALIBRATE_POSITIONS * i;
+      sector = sector / unit * unit + unit * CALIBRATE_STEPS;
+
+      if (check_sectors(st, fd, buffer, sector, unit) != 0)
+        continue;
+
+      for (size_t j=0; j < CALIBRATE_STEPS; j++)
+        {
+          sector -= unit;
+
+          time_start = timing_now();
+          if (check_sectors(st, fd, buffer, sector, unit) != 0)
+            break;
+          time_end = timing_now();
+
+          bi_add_time(&times, timing_ms(read_elapsed(time_start, time_end)));
+        }
+    }
+
+  ret = bi_quantile(&times, 1, 2);
+  bi_clear(&times);
+
+  return ret;
+}
+
+/**
+ * find size of the disk read cache
+ *
+ * A block is read, followed by growing amount of data after it and then
+ * the block is read again, as long as the second read is served from
+ * cache, the cache is bigger than the data read after the block
+ *
+ * @return cache size in MiB (rounded up to power of two), 0 if it couldn't
+ * be measured
+ */
+static size_t
+measure_disk_cache(struct status_t *st, int fd, char *buffer)
+{
+  int64_t time_start, time_end; ///< start and end of re-read, in ns
+  double time; ///< time it took to re-read the block, in ms
+  off_t blocks_in_mib = 1024 * 1024 / 512 / st->sectors;
+  off_t block = 0;
+  size_t cache = 0;
+
+  for (size_t mib=1; mib <= CALIBRATE_MAX_CACHE; mib *= 2)
+    {
+      // every size is checked on data that wasn't read before
+      if (block + 1 + blocks_in_mib * mib >= st->number_of_blocks)
+        break;
+
+      if (check_sectors(st, fd, buffer, block * st->sectors, st->sectors))
+        return 0;
+      for (off_t i=1; i <= blocks_in_mib * mib; i++)
+        if (check_sectors(st, fd, buffer, (block + i) * st->sectors,
+              st->sectors))
+          return 0;
+
+      time_start = timing_now();
+      if (check_sectors(st, fd, buffer, block * st->sectors, st->sectors))
+        return 0;
+      time_end = timing_now();
+
+      time = timing_ms(read_elapsed(time_start, time_end));
+
+      if (st->verbosity > 2)
+        printf("re-read after %zi MiB: %.3fms%s\n", mib, time,
+            CLEAR_LINE_END);
+
+      // read from platters needs to wait for the sector to come under the
+      // head, cache hits are much faster than that; reading this much is
+      // enough to flush the cache
+      if (time > st->rotational_delay / 4)
+        return mib;
+
+      cache = mib;
+      block += 1 + blocks_in_mib * mib;
+    }
+
+  return cache;
+}
+
+/**
+ * measure rotational delay and disk cache size, update block thresholds
+ * accordingly
+ *
+ * @return 0 if the disk was calibrated, -1 if configured values are used
+ */
+int
+calibrate_disk(struct status_t *st, int dev_fd)
+{
+  const double known_rpm[] = { 3600, 4200, 5400, 5900, 7200, 10000, 15000 };
+  unsigned int physical_size;
+  char *buffer;
+  double delay, rpm;
+  size_t cache;
+
+  if (st->nodirect)
+    {
+      printf("Calibration needs O_DIRECT, using configured values%s\n",
+          CLEAR_LINE_END);
+      if (st->flog != NULL)
+        fprintf(st->flog, "calibration skipped, O_DIRECT disabled\n");
+      return -1;
+    }
+
+  if (ioctl(dev_fd, BLKPBSZGET, &physical_size) == -1 ||
+      physical_size < 512)
+    physical_size = 512;
+
+  if (posix_memalign((void **)&buffer, pagesize, st->sectors * 512) != 0)
+    err(EXIT_FAILURE, "calibrate_disk");
+
+  if (st->verbosity >= 0)
+    printf("calibrating...%s\n", CLEAR_LINE_END);
+
+  delay = measure_rotational_delay(st, dev_fd, buffer, physical_size / 512);
+  rpm = 60.0 * 1000 / delay;
+
+  // anything faster than 20000rpm isn't spinning rust, nothing is slower
+  // than 3600rpm, less the 5% of command overhead allowed below
+  if (isnan(delay) || rpm > 20000 || rpm < 3600 * 0.95)
+    {
+      if (st->verbosity >= 0)
+        printf("no plausible rotational delay found, using configured "
+            "%.0frpm and %ziMiB cache%s\n", 1000 / st->rotational_delay * 60,
+            st->disk_cache_size, CLEAR_LINE_END);
+      if (st->flog != NULL)
+        fprintf(st->flog, "calibration didn't find rotational delay "
+            "(%.3fms measured)\n", delay);
+      free(buffer);
+      return -1;
+    }
+
+  // measurement includes command overhead, prefer standard speeds
+  for (size_t i=0; i < sizeof(known_rpm)/sizeof(known_rpm[0]); i++)
+    if (fabs(rpm - known_rpm[i]) / known_rpm[i] < 0.05)
+      {
+        rpm = known_rpm[i];
+        break;
+      }
+  st->rotational_delay = 60.0 * 1000 / rpm;
+
+  cache = measure_disk_cache(st, dev_fd, buffer);
+  if (cache > 0)
+    st->disk_cache_size = cache;
+
+  set_block_thresholds(st);
+
+  if (st->verbosity >= 0)
+    printf("calibrated: %.0frpm (revolution: %.3fms), %ziMiB cache%s\n",
+        rpm, delay, st->disk_cache_size, CLEAR_LINE_END);
+  if (st->flog != NULL)
+    {
+      fprintf(st->flog, "Calibrated %.0frpm disk (measured revolution: "
+          "%.3fms) with %ziMiB cache%s\n", rpm, delay, st->disk_cache_size,
+          (cache > 0) ? "" : " (configured)");
+      fprintf(st->flog, "Block thresholds: %.2f, %.2f, %.2f, %.2f, %.2f, "
+          "%.2f, \n",
+          st->vvfast_lvl,
+          st->vfast_lvl,
+          st->fast_lvl,
+          st->normal_lvl,
+          st->slow_lvl,
+          st->vslow_lvl
+          );
+    }
+
+  free(buffer);
+  return 0;
+}
+
+/**
+ * copy SCSI INQUIRY string, without trailing spaces
+ */
+static void
+copy_inquiry_string(char *dst, const char *src, size_t len)
+{
+  size_t end;
+
+  for (end = strlen(src); end > 0 && src[end-1] == ' '; end--)
+    ;
+  if (end >= len)
+    end = len - 1;
+  memcpy(dst, src, end);
+  dst[end] = '\0';
+}
+
+/**
+ * get model and firmware revision of the disk from SCSI INQUIRY (SAT
+ * translated ATA IDENTIFY for ATA disks)
+ *
+ * @param[out] model vendor, model and firmware revision separated by spaces
+ * @return 0 on success, -1 if the device can't be identified
+ */
+int
+get_disk_model(int dev_fd, char *model, size_t len)
+{
+  struct sg_simple_inquiry_resp inq;
+  char vendor[9], product[17], revision[5];
+
+  if (sg_simple_inquiry(dev_fd, &inq, 0, 0) != 0)
+    return -1;
+
+  copy_inquiry_string(vendor, inq.vendor, sizeof(vendor));
+  copy_inquiry_string(product, inq.product, sizeof(product));
+  copy_inquiry_string(revision, inq.revision, sizeof(revision));
+
+  if (product[0] == '\0')
+    return -1;
+
+  snprintf(model, len, "%s %s %s", vendor, product, revision);
+  return 0;
+}
+
+/**
+ * load calibration of disk model from profiles file
+ *
+ * Every line of the file holds one model: the model string, tab, rotational
+ * delay (ms), cache size (MiB) and the six block thresholds (ms)
+ *
+ * @return 0 if profile was found, -1 otherwise
+ */
+int
+load_profile(struct status_t *st, const char *path, const char *model)
+{
+  FILE *file;
+  char line[512];
+  int ret = -1;
+
+  file = fopen(path, "r");
+  if (file == NULL)
+    {
+      if (errno != ENOENT)
+        warn("%s", path);
+      return -1;
+    }
+
+  while (fgets(line, sizeof(line), file) != NULL)
+    {
+      char *values = strrchr(line, '\t');
+      double delay, lvl[6];
+      size_t cache;
+
+      if (values == NULL)
+        continue;
+      *values++ = '\0';
+      if (strcmp(line, model) != 0)
+        continue;
+
+      if (sscanf(values, "%lf %zi %lf %lf %lf %lf %lf %lf", &delay, &cache,
+            &lvl[0], &lvl[1], &lvl[2], &lvl[3], &lvl[4], &lvl[5]) != 8 ||
+          delay <= 0)
+        {
+          warnx("%s: invalid profile of %s", path, model);
+          continue;
+        }
+
+      st->rotational_delay = delay;
+      st->disk_cache_size = cache;
+      st->vvfast_lvl = lvl[0];
+      st->vfast_lvl = lvl[1];
+      st->fast_lvl = lvl[2];
+      st->normal_lvl = lvl[3];
+      st->slow_lvl = lvl[4];
+      st->vslow_lvl = lvl[5];
+      ret = 0;
+    }
+
+  fclose(file);
+  return ret;
+}
+
+/**
+ * save calibration of disk model to profiles file, replacing the old
+ * profile of the model
+ *
+ * Many instances of hdck testing disks of the same model can finish
+ * calibration together, so the file is re-read and replaced while holding
+ * a lock on PATH.lock; readers don't need the lock as the new file is
+ * renamed over the old one.
+ */
+void
+save_profile(struct status_t *st, const char *path, const char *model)
+{
+  FILE *file, *tmp = NULL;
+  struct stat file_stat;
+  char *lock_path, *tmp_path;
+  char line[512];
+  size_t model_len = strlen(model);
+  int lock_fd, tmp_fd;
+
+  lock_path = malloc(strlen(path) + 6);
+  tmp_path = malloc(strlen(path) + 8);
+  if (lock_path == NULL || tmp_path == NULL)
+    err(EXIT_FAILURE, "save_profile");
+  sprintf(lock_path, "%s.lock", path);
+  // in the same directory, so that it can be renamed over path
+  sprintf(tmp_path, "%s.XXXXXX", path);
+
+  // the lock file is left in place, removing it would race with instances
+  // waiting for the lock
+  lock_fd = open(lock_path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (lock_fd < 0)
+    {
+      warn("%s", lock_path);
+      goto out;
+    }
+  if (flock(lock_fd, LOCK_EX) == -1)
+    {
+      warn("%s", lock_path);
+      goto unlock;
+    }
+
+  tmp_fd = mkstemp(tmp_path);
+  if (tmp_fd < 0)
+    {
+      warn("%s", tmp_path);
+      goto unlock;
+    }
+  // mkstemp() creates files readable only by the owner
+  if (stat(path, &file_stat) == 0)
+    fchmod(tmp_fd, file_stat.st_mode & 07777);
+  else
+    fchmod(tmp_fd, 0644);
+
+  tmp = fdopen(tmp_fd, "w");
+  if (tmp == NULL)
+    {
+      warn("%s", tmp_path);
+      close(tmp_fd);
+      goto failed;
+    }
+
+  // other instances could have saved their profiles since it was loaded
+  file = fopen(path, "r");
+  if (file != NULL)
+    {
+      while (fgets(line, sizeof(line), file) != NULL)
+        if (strncmp(line, model, model_len) != 0 || line[model_len] != '\t')
+          fputs(line, tmp);
+      fclose(file);
+    }
+  else if (errno != ENOENT)
+    {
+      warn("%s", path);
+      fclose(tmp);
+      goto failed;
+    }
+
+  fprintf(tmp, "%s\t%.6f %zi %.6f %.6f %.6f %.6f %.6f %.6f\n", model,
+      st->rotational_delay, st->disk_cache_size, st->vvfast_lvl,
+      st->vfast_lvl, st->fast_lvl, st->normal_lvl, st->slow_lvl,
+      st->vslow_lvl);
+
+  if (fflush(tmp) != 0 || fsync(fileno(tmp)) != 0)
+    {
+      warn("%s", tmp_path);
+      fclose(tmp);
+      goto failed;
+    }
+  if (fclose(tmp) != 0)
+    {
+      warn("%s", tmp_path);
+      goto failed;
+    }
+  if (rename(tmp_path, path) != 0)
+    {
+      warn("%s", path);
+      goto failed;
+    }
+
+  if (st->flog != NULL)
+    fprintf(st->flog, "Saved profile of %s to %s\n", model, path);
+  goto unlock;
+
+failed:
+  unlink(tmp_path);
+unlock:
+  close(lock_fd); // releases the lock
+out:
+  free(lock_path);
+  free(tmp_path);
+}
 
-          //update_block_stats(st, block_info);
-        }
-      else // when the read was correct
-        {
-          diff_time(&res, time1, time2);
-          //make the times stored in block struct in ms not in ns
-          times_time(&res, 1000);
+/// number of timed reads of each half of a range when zooming into a block
+#define ZOOM_PROBES 3
+/// number of timed reads of the smallest ranges found when zooming
+#define ZOOM_SAMPLES 9
 
-          // update only if we can gather meaningful data
-          if (bi_is_valid(&block_info[blocks]) == 0 ||
-              (bi_is_valid(&block_info[blocks]) && next_is_valid == 1))
-            {
-              if (bi_is_valid(&block_info[blocks]) == 0 && next_is_valid == 1)
-                {
-                  // first valid read
-                  bi_clear(&block_info[blocks]);
-                  add_block(st, &block_info[blocks], time_double(res));
-                  bi_make_valid(&block_info[blocks]);
-                  st->invalid--;
-                  add_block_to_stats(st, time_double(res));
+/**
+ * read range of sectors with timing
+ *
+ * Blocks before the range are read first to exclude seek time and flush the
+ * disk cache, like read_blocks() does
+ *
+ * @param[out] time read time in ms
+ * @return 0 if the range was read, -1 otherwise with errno set
+ */
+static int
+zoom_read(struct status_t *st, int fd, char *buffer, off_t sector,
+    off_t count, double *time)
+{
+  int64_t time_start, time_end; ///< start and end of read, in ns
+  off_t warm_up = st->sectors * ((st->usb_mode) ? 17 : 2);
+  int ret;
 
-                  if (st->verbosity > 10)
-                    printf("block: %zi, samples: %zi, average: "
-                        "%f, rel stdev: %f, trunc rel stdev: %f%s\n",
-                        blocks,
-                        bi_num_samples(&block_info[blocks]),
-                        bi_average(&block_info[blocks]),
-                        bi_rel_stdev(&block_info[blocks]),
-                        bi_int_rel_stdev(&block_info[blocks]),
-                        CLEAR_LINE_END);
-                }
-              else
-                {
-                  // subsequent valid or invalid reads
-                  add_block(st, &block_info[blocks], time_double(res));
+  for (off_t pos = (sector > warm_up) ? sector - warm_up : 0; pos < sector;
+      pos += st->sectors)
+    {
+      off_t len = (sector - pos < st->sectors) ? sector - pos : st->sectors;
+      check_sectors(st, fd, buffer, pos, len);
+      // XXX ignore errors
+    }
 
-                  if (st->verbosity > 10)
-                    printf("block: %zi, samples: %zi, average: "
-                        "%f, rel stdev: %f, trunc rel stdev: %f%s\n",
-                        blocks,
-                        bi_num_samples(&block_info[blocks]),
-                        bi_average(&block_info[blocks]),
-                        bi_rel_stdev(&block_info[blocks]),
-                        bi_int_rel_stdev(&block_info[blocks]),
-                        CLEAR_LINE_END);
-                }
-              diff_time(&res, time1, time2);
-            }
+  time_start = timing_now();
+  ret = check_sectors(st, fd, buffer, sector, count);
+  time_end = timing_now();
 
-          next_is_valid = 1;
+  *time = timing_ms(read_elapsed(time_start, time_end));
+
+  return ret;
+}
+
+/**
+ * read range of sectors number of times, collecting times and errors
+ */
+static void
+zoom_sample(struct status_t *st, int fd, char *buffer, off_t sector,
+    off_t count, size_t reads, struct block_info_t *times)
+{
+  double time;
 
-          add_sample_to_stats(st, time_double(res) * 1000);
+  bi_init(times);
+  bi_make_valid(times);
+  for (size_t i=0; i < reads; i++)
+    {
+      if (zoom_read(st, fd, buffer, sector, count, &time) == 0)
+        bi_add_time(times, time);
+      else if (errno == ETIMEDOUT)
+        {
+          bi_add_timeout(times);
+          break; // another read would take just as long
         }
+      else
+        bi_add_error(times);
+    }
+}
 
-      if (st->sector_times == PRINT_TIMES)
-        printf("%li r:%lli rs: %lli w:%lli%s\n",
-            res.tv_nsec/1000+res.tv_sec*1000000,
-            read_s,
-            read_sec_s,
-            write_s,
-            CLEAR_LINE_END);
+/**
+ * split range in halves recursively, following the halves that are
+ * unreadable or slow, down to single physical sectors
+ *
+ * Ranges that can't be narrowed down further are saved in st->zoomed
+ *
+ * @param unit size of physical sector, in 512 byte sectors
+ */
+static void
+zoom_range(struct status_t *st, int fd, char *buffer, off_t sector,
+    off_t count, off_t unit)
+{
+  struct block_info_t times;
+  int suspect_parts = 0;
 
-      blocks++;
-      abs_blocks++;
+  if (count > unit)
+    {
+      // split on physical sector boundary
+      off_t half = count / unit / 2 * unit;
+      off_t starts[2] = { sector, sector + half };
+      off_t lengths[2] = { half, count - half };
 
-      if (blocks % 500 == 0 && st->verbosity >= 0)
+      for (size_t i=0; i < 2; i++)
         {
-          clock_gettime(TIMER_TYPE, &timee);
-          diff_time(&res, time1, time2);
+          if (time_left(st) <= 0)
+            {
+              st->deadline_hit = 1;
+              return;
+            }
 
-          float cur_speed;
-          cur_speed = st->sectors * 512 / 1024 * 1.0f / 1024 /
-            (res.tv_sec * 1.0f + res.tv_nsec / 1000000000.0);
+          zoom_sample(st, fd, buffer, starts[i], lengths[i], ZOOM_PROBES,
+              &times);
+          if (bi_get_error(&times) || bi_get_timeout(&times) ||
+              bi_quantile(&times, 1, 2) >= st->normal_lvl)
+            {
+              zoom_range(st, fd, buffer, starts[i], lengths[i], unit);
+              suspect_parts++;
+            }
+          bi_clear(&times);
+        }
 
-          diff_time(&res, times, timee);
+      // when the problem doesn't show up in smaller reads report the
+      // whole range
+      if (suspect_parts > 0)
+        return;
+    }
 
-          float speed;
-          speed = abs_blocks * st->sectors * 512 / 1024 * 1.0f / 1024 /
-            (res.tv_sec * 1.0f + res.tv_nsec / 1000000000.0);
+  zoom_sample(st, fd, buffer, sector, count, ZOOM_SAMPLES, &times);
 
-          float percent;
-          if (st->max_sectors == 0)
-            percent = (blocks * st->sectors * 512.0f) / (filesize * 1.0f);
-          else
-            percent = (blocks * st->sectors * 512.0f) /
-              (st->max_sectors * st->sectors * 2.0f);
+  if (st->zoomed_len + 1 >= st->zoomed_alloc)
+    {
+      st->zoomed_alloc = (st->zoomed_alloc) ? st->zoomed_alloc * 2 : 16;
+      st->zoomed = realloc(st->zoomed,
+          sizeof(struct sector_info_t) * st->zoomed_alloc);
+      if (st->zoomed == NULL)
+        err(EXIT_FAILURE, "zoom_range");
+    }
+  st->zoomed[st->zoomed_len].lba = sector;
+  st->zoomed[st->zoomed_len].len = count;
+  st->zoomed[st->zoomed_len].times = times;
+  st->zoomed_len++;
+}
 
-          long long time_to_go;
-          time_to_go = (res.tv_sec*1.0) /
-                            (percent/st->min_reads + loop*1.0/st->min_reads);
+/**
+ * find exact slow and unreadable sectors inside blocks that were slow or
+ * unreadable
+ *
+ * Blocks are re-read in progressively smaller parts, down to the physical
+ * sector size, results are left in st->zoomed
+ */
+void
+zoom_suspect_blocks(struct status_t *st, int dev_fd,
+    struct block_info_t *block_info)
+{
+  unsigned int physical_size;
+  off_t unit;
+  char *buffer;
+  size_t zoomed = 0;
 
-          printf("hdck status:%s\n", CLEAR_LINE_END);
-          printf("============%s\n", CLEAR_LINE_END);
-          printf("Loop:          %zi of %zi%s\n", loop+1, st->min_reads,
-              CLEAR_LINE_END);
-          printf("Progress:      %.2f%%, %.2f%% total%s\n",
-              percent*100,
-              (percent/st->min_reads + loop*1.0/st->min_reads) * 100,
-              CLEAR_LINE_END);
-          printf("Read:          %lli sectors of %lli%s\n",
-              ((off_t)blocks)*(long long)st->sectors,
-              (long long)filesize, CLEAR_LINE_END);
-          printf("Speed:         %.3fMiB/s, average: %.3fMiB/s%s\n", cur_speed,
-              speed, CLEAR_LINE_END);
-          printf("Elapsed time:  %02li:%02li:%02li%s\n",
-              res.tv_sec/3600, res.tv_sec/60%60, res.tv_sec%60,
-              CLEAR_LINE_END);
-          printf("Expected time: %02lli:%02lli:%02lli%s\n",
-              time_to_go/3600, time_to_go/60%60, time_to_go%60,
-              CLEAR_LINE_END);
-          printf("         Samples:             Blocks (9th decile):%s\n",
-              CLEAR_LINE_END);
-          printf("<%4.1fms: %20lli %20lli%s\n", st->vvfast_lvl, st->tot_vvfast,
-              st->vvfast, CLEAR_LINE_END);
-          printf("<%4.1fms: %20lli %20lli%s\n", st->vfast_lvl, st->tot_vfast,
-              st->vfast, CLEAR_LINE_END);
-          printf("<%4.1fms: %20lli %20lli%s\n", st->fast_lvl, st->tot_fast,
-              st->fast, CLEAR_LINE_END);
-          printf("<%4.1fms: %20lli %20lli%s\n", st->normal_lvl, st->tot_normal,
-              st->normal, CLEAR_LINE_END);
-          printf("<%4.1fms: %20lli %20lli%s\n", st->slow_lvl, st->tot_slow,
-              st->slow, CLEAR_LINE_END);
-          printf("<%4.1fms: %20lli %20lli%s\n", st->vslow_lvl, st->tot_vslow,
-              st->vslow, CLEAR_LINE_END);
-          printf(">%4.1fms: %20lli %20lli%s\n", st->vslow_lvl, st->tot_vvslow,
-              st->vvslow, CLEAR_LINE_END);
-          printf("ERR    : %20lli %20lli%s\n", st->tot_errors,
-              st->errors, CLEAR_LINE_END);
-          printf("Intrrpt: %20lli %20lli%s\n", st->tot_interrupts,
-              st->invalid, CLEAR_LINE_END);
-          printf("\r%s", cursor_up(18));
-          fflush(stdout);
-        }
+  if (ioctl(dev_fd, BLKPBSZGET, &physical_size) == -1 ||
+      physical_size < 512)
+    physical_size = 512;
+  unit = physical_size / 512;
 
-      // check whether we have to leave the loop
-      if (nread == 0 || nread == -1 || blocks >= number_of_blocks
-          || (st->max_sectors != 0 && blocks * st->sectors >= st->max_sectors))
-        {
-          long long high_dev=0;
-          long long sum_invalid=0;
-          loop++;
+  if (posix_memalign((void **)&buffer, pagesize, st->sectors * 512) != 0)
+    err(EXIT_FAILURE, "zoom_suspect_blocks");
 
-          update_block_stats(st, block_info);
+  for (off_t block=0; block < st->number_of_blocks; block++)
+    {
+      struct block_info_t *bi = &block_info[block];
 
-          // check standard deviation for blocks
-          for (size_t i =0; i < blocks; i++)
-            {
-              if (bi_int_rel_stdev(&block_info[i]) > st->max_std_dev)
-                high_dev++;
+      if (!bi_is_initialised(bi) || is_skipped(st, block))
+        continue;
 
-              if (bi_is_valid(&block_info[i]) == 0)
-                sum_invalid++;
-            }
-          if (loop < st->min_reads ||
-              high_dev/(blocks*1.0) > 0.25 ||
-              sum_invalid/(blocks*1.0) > 0.10)
-            {
-              if (
-                  st->verbosity >= 0 &&
-                  !(loop < st->min_reads) &&
-                  ( high_dev/(blocks*1.0) > 0.25
-                    || sum_invalid/(blocks*1.0) > 0.10)
-                 )
-                printf("low confidance for the results, "
-                    "re-reading whole disk%s\n", CLEAR_LINE_END);
+      // a read that timed out would take just as long again
+      if (bi_get_timeout(bi))
+        continue;
 
-              blocks=0;
-              // seek to first block
-              if (lseek(dev_fd, (off_t)0, SEEK_SET) < 0)
-                {
-                  nread = -1; // exit loop, end of device
-                }
-              // try to place first sector in cache
-              if (!st->ata_verify)
-                {
-                  nread = read(dev_fd, ibuf, 512);
-                  if (lseek(dev_fd, (off_t)0, SEEK_SET) < 0)
-                    {
-                      nread = -1; // exit loop, end of device
-                    }
-                }
-              clock_gettime(TIMER_TYPE, &time2);
-              // TODO: flush system buffers when no direct
-            }
-          else
-            break;
+      if (bi_get_error(bi) == 0 &&
+          (!bi_is_valid(bi) || bi_num_samples(bi) == 0 ||
+           bi_quantile(bi, 9, 10) < st->normal_lvl))
+        continue;
 
-          if (loop > st->max_reads + st->min_reads)
-            {
-              printf("Warning: read whole disk %zi times, still "
-                  "can't get high confidence%s\n", st->max_reads,
-                  CLEAR_LINE_END);
-              break;
-            }
+      if (time_left(st) <= 0)
+        {
+          st->deadline_hit = 1;
+          break;
         }
+
+      if (st->verbosity > 1)
+        printf("zooming into block %lli%s\n", (long long)block,
+            CLEAR_LINE_END);
+
+      zoom_range(st, dev_fd, buffer, block * st->sectors, st->sectors, unit);
+      zoomed++;
     }
- free(ibuf_free);
+
+  if (st->flog != NULL)
+    fprintf(st->flog, "zoomed into %zi blocks, found %zi slow or unreadable "
+        "ranges\n", zoomed, st->zoomed_len);
+
+  free(buffer);
 }
 
 int
@@ -2620,13 +6521,77 @@ main(int argc, char **argv)
   st.vvslow = 0;
   st.tot_interrupts = 0;
   st.invalid = 0;
+  st.timeout = 0.0;
+  st.tot_timeouts = 0;
+  st.timeouts = 0;
   st.quick = 0;
+  st.progressive = 0;
+  st.sprt = 0;
+  st.deadline.tv_sec = 0;
+  st.deadline.tv_nsec = 0;
+  st.deadline_reserve = 0.0;
+  st.deadline_hit = 0;
+  st.reread_cost = 0.0;
+  st.reread_direction = 1;
+  st.state_file = NULL;
+  st.skip_errors = 0;
+  br_init(&st.skipped);
+  br_init(&st.unscanned);
+  st.expand = 0;
+  st.damaged = NULL;
+  st.damaged_len = 0;
+  st.zoom = 0;
+  st.zoomed = NULL;
+  st.zoomed_len = 0;
+  st.zoomed_alloc = 0;
+  st.zone_median = NULL;
+  st.speed = NULL;
+  st.speed_len = 0;
+  st.heatmap = NULL;
+  st.heatmap_width = 0;
+  st.loop_times = NULL;
+  st.loop_times_len = 0;
+  st.reread_time = 0;
+  st.metrics = NULL;
+  st.profile = NULL;
+  st.sample_pool = NULL;
+  st.sample_pool_size = 0;
+  st.scan_faults = 0;
+  st.scan_spills = 0;
+  st.reread_buffer = NULL;
+  st.reread_buffer_free = NULL;
+  st.chunk_data = NULL;
+  st.chunk_samples = NULL;
+  st.chunk_size = 0;
+  st.phase = METRICS_STARTING;
+  memset(st.latency, 0, sizeof(st.latency));
   //st.time_end;
   //st.time_start;
 
   int c;
   /// path to the `stat' file for the corresponding hardware device
   char* read_sectors_from_file = NULL; ///< file with sectors to scan to
+  char* fs_extents = NULL; ///< file system or file list to scan extents of
+  double sample_fraction = 0; ///< fraction of disk to sample
+  double sample_duration = 0; ///< time to sample disk for, in seconds
+  double deadline = 0; ///< time the whole test can take, in seconds
+  int errors_only = 0; ///< look only for unreadable sectors
+  int calibrate = 0; ///< measure rotational delay and disk cache size
+  char* profiles = NULL; ///< file with calibration results of disk models
+  char model[64] = ""; ///< model and firmware of tested disk
+  int zones = 0; ///< use zone baselines
+  char* speed_profile = NULL; ///< file to write speed profile to
+  char* heatmap = NULL; ///< prefix of files to write heatmap to
+  char* json_file = NULL; ///< file to write JSON report to
+  FILE* json_handle = NULL; ///< open json_file
+  char* metrics_file = NULL; ///< file to keep live metrics in
+  char* metrics_socket = NULL; ///< Unix socket to serve live metrics on
+  double metrics_interval = 1; ///< how often to refresh metrics file
+  struct metrics_t metrics; ///< live metrics publisher
+  double refresh = 0; ///< status redraws per second, 0 for default
+  int self_profile = 0; ///< measure hdck's own overhead
+  struct self_profile_t profile; ///< hdck's own overhead
+  int mlock_memory = 0; ///< keep all memory resident during the test
   char* log_path = NULL; ///< path to file to write log to
   struct block_info_t* block_info = NULL;
   struct timespec res; /// temporary timespec result
@@ -2671,6 +6636,29 @@ main(int argc, char **argv)
         {"no-usb", 0, 0, 0}, // 25
         {"ata-verify", 0, 0, 0}, // 26
         {"no-ata-verify", 0, 0, 0}, // 27
+        {"fs-extents", 1, 0, 0}, // 28
+        {"sample", 1, 0, 0}, // 29
+        {"progressive", 0, &st.progressive, 1}, // 30
+        {"sprt", 0, &st.sprt, 1}, // 31
+        {"deadline", 1, 0, 0}, // 32
+        {"state", 1, 0, 0}, // 33
+        {"errors-only", 0, &errors_only, 1}, // 34
+        {"skip-errors", 0, &st.skip_errors, 1}, // 35
+        {"timeout", 1, 0, 0}, // 36
+        {"expand", 0, &st.expand, 1}, // 37
+        {"zoom", 0, &st.zoom, 1}, // 38
+        {"calibrate", 0, &calibrate, 1}, // 39
+        {"profiles", 1, 0, 0}, // 40
+        {"zones", 0, &zones, 1}, // 41
+        {"speed-profile", 1, 0, 0}, // 42
+        {"heatmap", 1, 0, 0}, // 43
+        {"json", 1, 0, 0}, // 44
+        {"metrics-file", 1, 0, 0}, // 45
+        {"metrics-socket", 1, 0, 0}, // 46
+        {"metrics-interval", 1, 0, 0}, // 47
+        {"refresh", 1, 0, 0}, // 48
+        {"self-profile", 0, &self_profile, 1}, // 49
+        {"mlock", 0, &mlock_memory, 1}, // 50
         {0, 0, 0, 0}
     };
 
@@ -2748,6 +6736,116 @@ main(int argc, char **argv)
             st.ata_verify = 0;
             break;
           }
+        if (option_index == 28)
+          {
+            fs_extents = optarg;
+            break;
+          }
+        if (option_index == 32)
+          {
+            deadline = parse_duration(optarg);
+            if (deadline <= 0)
+              {
+                printf("invalid --deadline value: %s%s\n", optarg,
+                    CLEAR_LINE_END);
+                usage(&st);
+                exit(EXIT_FAILURE);
+              }
+            break;
+          }
+        if (option_index == 33)
+          {
+            st.state_file = optarg;
+            break;
+          }
+        if (option_index == 48)
+          {
+            refresh = atof(optarg);
+            if (refresh <= 0)
+              {
+                printf("invalid --refresh value: %s%s\n", optarg,
+                    CLEAR_LINE_END);
+                usage(&st);
+                exit(EXIT_FAILURE);
+              }
+            break;
+          }
+        if (option_index == 47)
+          {
+            // plain number is in seconds
+            if ((metrics_interval = parse_duration(optarg)) < 0)
+              metrics_interval = atof(optarg);
+            if (metrics_interval <= 0)
+              {
+                printf("invalid --metrics-interval value: %s%s\n", optarg,
+                    CLEAR_LINE_END);
+                usage(&st);
+                exit(EXIT_FAILURE);
+              }
+            break;
+          }
+        if (option_index == 46)
+          {
+            metrics_socket = optarg;
+            break;
+          }
+        if (option_index == 45)
+          {
+            metrics_file = optarg;
+            break;
+          }
+        if (option_index == 44)
+          {
+            json_file = optarg;
+            break;
+          }
+        if (option_index == 43)
+          {
+            heatmap = optarg;
+            break;
+          }
+        if (option_index == 42)
+          {
+            speed_profile = optarg;
+            break;
+          }
+        if (option_index == 40)
+          {
+            profiles = optarg;
+            break;
+          }
+        if (option_index == 36)
+          {
+            // plain number is in seconds
+            if ((st.timeout = parse_duration(optarg)) < 0)
+              st.timeout = atof(optarg);
+            if (st.timeout <= 0)
+              {
+                printf("invalid --timeout value: %s%s\n", optarg,
+                    CLEAR_LINE_END);
+                usage(&st);
+                exit(EXIT_FAILURE);
+              }
+            break;
+          }
+        if (option_index == 29)
+          {
+            size_t arg_len = strlen(optarg);
+            if (arg_len > 0 && optarg[arg_len-1] == '%')
+              sample_fraction = atof(optarg) / 100;
+            else if ((sample_duration = parse_duration(optarg)) < 0)
+              sample_fraction = atof(optarg);
+
+            if (sample_duration <= 0 &&
+                (sample_fraction <= 0 || sample_fraction > 1))
+              {
+                printf("invalid --sample value: %s%s\n", optarg,
+                    CLEAR_LINE_END);
+                usage(&st);
+                exit(EXIT_FAILURE);
+              }
+            break;
+          }
         break;
 
     case 'v':
@@ -2821,6 +6919,39 @@ main(int argc, char **argv)
       exit(EXIT_FAILURE);
     }
 
+  if (read_sectors_from_file != NULL && fs_extents != NULL)
+    {
+      printf("-r and --fs-extents are mutually exclusive%s\n", CLEAR_LINE_END);
+      usage(&st);
+      exit(EXIT_FAILURE);
+    }
+
+  if (errors_only && (read_sectors_from_file != NULL || fs_extents != NULL ||
+      sample_fraction > 0 || sample_duration > 0))
+    {
+      printf("--errors-only can't be used with -r, --fs-extents or --sample%s\n",
+          CLEAR_LINE_END);
+      usage(&st);
+      exit(EXIT_FAILURE);
+    }
+
+  if (json_file != NULL && (errors_only || sample_fraction > 0 ||
+      sample_duration > 0))
+    {
+      printf("--json can't be used with --errors-only or --sample%s\n",
+          CLEAR_LINE_END);
+      usage(&st);
+      exit(EXIT_FAILURE);
+    }
+
+  // don't find out that the report can't be written after hours of testing
+  if (json_file != NULL)
+    {
+      json_handle = fopen(json_file, "w");
+      if (json_handle == NULL)
+        err(EXIT_FAILURE, "%s", json_file);
+    }
+
   if (st.exclusive)
     {
       if (st.min_reads == 0)
@@ -2849,28 +6980,7 @@ main(int argc, char **argv)
         st.max_std_dev = 0.5;
     }
 
-  // typical read takes about a fifth of rotational delay
-  // (value arrived at experimentally, by reading blocks few thousand times)
-  double baseline = st.rotational_delay / 5.13;
-
-  if (st.vvfast_lvl < 0.0)
-    st.vvfast_lvl = baseline * 1.5;
-  if (st.vfast_lvl < 0.0)
-    // sectors that include cylinder change take twice as long as the normal
-    // read, but definitely are not re-reads
-    st.vfast_lvl = baseline + st.rotational_delay / 2;
-  if (st.fast_lvl < 0.0)
-    // ones that needed one re-read
-    st.fast_lvl = baseline + st.rotational_delay * 1.5;
-  if (st.normal_lvl < 0.0)
-    // at most two re-reads
-    st.normal_lvl = baseline + st.rotational_delay * 2.5;
-  if (st.slow_lvl < 0.0)
-    // four at most
-    st.slow_lvl = baseline + st.rotational_delay * 4.5;
-  if (st.vslow_lvl < 0.0)
-    // six at most
-    st.vslow_lvl = baseline + st.rotational_delay * 6.5;
+  set_block_thresholds(&st);
 
   if (log_path != NULL)
     {
@@ -2887,17 +6997,110 @@ main(int argc, char **argv)
       fprintf(st.flog, "max standard deviation: %f\n", st.max_std_dev);
       if(st.exclusive)
         {
-          fprintf(st.flog, "Exclusive access specified\n");
+          fprintf(st.flog, "Exclusive access specified\n");
+        }
+      if(st.quick)
+        {
+          fprintf(st.flog, "Quick mode!\n");
+        }
+      if(st.progressive)
+        {
+          fprintf(st.flog, "Progressive scan order\n");
+        }
+      if(st.sprt)
+        {
+          fprintf(st.flog, "Sequential probability ratio test for re-reads\n");
+        }
+      if(errors_only)
+        {
+          fprintf(st.flog, "Looking only for unreadable sectors\n");
+        }
+      if(st.skip_errors)
+        {
+          fprintf(st.flog, "Skipping ahead after consecutive read errors\n");
+        }
+      if(deadline > 0)
+        {
+          fprintf(st.flog, "Deadline: %.0fs\n", deadline);
+        }
+      if(st.expand)
+        {
+          fprintf(st.flog, "Probing neighbourhood of suspect blocks\n");
         }
-      if(st.quick)
+      if(st.zoom)
         {
-          fprintf(st.flog, "Quick mode!\n");
+          fprintf(st.flog, "Zooming into suspect blocks\n");
+        }
+      if(calibrate)
+        {
+          fprintf(st.flog, "Calibrating disk RPM and cache size\n");
+        }
+      if(zones)
+        {
+          fprintf(st.flog, "Using zone baselines\n");
+        }
+      if(speed_profile != NULL)
+        {
+          fprintf(st.flog, "Writing speed profile to %s\n", speed_profile);
+        }
+      if(heatmap != NULL)
+        {
+          fprintf(st.flog, "Writing heatmap to %s.ppm and %s.pyr\n",
+              heatmap, heatmap);
+        }
+      if(json_file != NULL)
+        {
+          fprintf(st.flog, "Writing JSON report to %s\n", json_file);
+        }
+      if(metrics_file != NULL)
+        {
+          fprintf(st.flog, "Writing metrics to %s every %.3fs\n",
+              metrics_file, metrics_interval);
+        }
+      if(metrics_socket != NULL)
+        {
+          fprintf(st.flog, "Serving metrics on %s\n", metrics_socket);
+        }
+      if(self_profile)
+        {
+          fprintf(st.flog, "Measuring hdck overhead\n");
+        }
+      if(mlock_memory)
+        {
+          fprintf(st.flog, "Locking memory\n");
+        }
+      if(refresh > 0)
+        {
+          fprintf(st.flog, "Redrawing status %.3f times a second\n",
+              refresh);
+        }
+      if(profiles != NULL)
+        {
+          fprintf(st.flog, "Using calibration profiles from %s\n", profiles);
+        }
+      if(st.timeout > 0)
+        {
+          fprintf(st.flog, "Read timeout: %.2fs\n", st.timeout);
         }
       if(read_sectors_from_file != NULL)
         {
           fprintf(st.flog, "Testing only ranges specified in file %s\n",
               read_sectors_from_file);
         }
+      if(fs_extents != NULL)
+        {
+          fprintf(st.flog, "Testing only extents used by files in %s\n",
+              fs_extents);
+        }
+      if(sample_fraction > 0)
+        {
+          fprintf(st.flog, "Sampling %.2f%% of the disk\n",
+              sample_fraction * 100);
+        }
+      if(sample_duration > 0)
+        {
+          fprintf(st.flog, "Sampling the disk for %.0fs\n", sample_duration);
+        }
       if(st.max_sectors != 0)
         {
           fprintf(st.flog, "Limiting device size to %lli sectors\n",
@@ -2943,6 +7146,26 @@ main(int argc, char **argv)
 
   int dev_fd = 0;
 
+  // start the metrics thread before the scheduling and CPU affinity of the
+  // process are changed, so that it doesn't inherit them
+  if (metrics_file != NULL || metrics_socket != NULL ||
+      (st.verbosity >= 0 && !errors_only))
+    {
+      metrics_render_t render = NULL;
+      int tty = isatty(STDOUT_FILENO);
+
+      // status is drawn at fixed rate, outside of the I/O thread; when
+      // output goes to a log keep it small
+      if (st.verbosity >= 0 && !errors_only)
+        render = (tty) ? render_status : render_status_line;
+      if (refresh <= 0)
+        refresh = (tty) ? 2 : 0.1;
+
+      metrics_start(&metrics, st.filename, metrics_file, metrics_socket,
+          metrics_interval, render, 1 / refresh);
+      st.metrics = &metrics;
+    }
+
   // make the process real-time
   if (!st.no_rt)
     make_real_time();
@@ -2959,6 +7182,14 @@ main(int argc, char **argv)
       set_rt_ioprio();
     }
 
+  // measure cost of reading the clock with the final scheduling settings
+  timing_init();
+  if (st.verbosity > 2)
+    printf("clock read overhead: %lldns\n", (long long)timing_overhead);
+  if (st.flog != NULL)
+    fprintf(st.flog, "Clock read overhead: %lldns\n",
+        (long long)timing_overhead);
+
   int flags = O_RDONLY | O_LARGEFILE;
   if (st.verbosity > 5)
     printf("setting O_RDONLY flag on file\n");
@@ -3035,6 +7266,15 @@ main(int argc, char **argv)
     st.number_of_blocks = lrintl(ceill(st.filesize*1.0L/512/st.sectors));
   else
     st.number_of_blocks = lrintl(ceill(st.max_sectors*1.0L/st.sectors));
+
+  if (st.number_of_blocks > BLOCK_NO_MAX)
+    {
+      fprintf(stderr, "File too big, block lists support at most %llu blocks "
+          "(%llu sectors)\n", (unsigned long long)BLOCK_NO_MAX,
+          (unsigned long long)BLOCK_NO_MAX * st.sectors);
+      exit(EXIT_FAILURE);
+    }
+
   block_info = calloc(st.number_of_blocks,
       sizeof(struct block_info_t));
   if (!block_info)
@@ -3044,6 +7284,33 @@ main(int argc, char **argv)
       err(EXIT_FAILURE, "calloc");
     }
 
+  if (zones)
+    {
+      st.zone_median = calloc(ZONE_COUNT, sizeof(double));
+      if (st.zone_median == NULL)
+        err(EXIT_FAILURE, "calloc");
+    }
+
+  if (speed_profile != NULL)
+    {
+      st.speed_len = (st.number_of_blocks < SPEED_BUCKETS) ?
+        st.number_of_blocks : SPEED_BUCKETS;
+      st.speed = calloc(st.speed_len, sizeof(struct speed_bucket_t));
+      if (st.speed == NULL)
+        err(EXIT_FAILURE, "calloc");
+    }
+
+  if (heatmap != NULL)
+    {
+      // levels of the pyramid halve the width
+      st.heatmap_width = HEATMAP_WIDTH;
+      while (st.heatmap_width > st.number_of_blocks)
+        st.heatmap_width /= 2;
+      st.heatmap = calloc(st.heatmap_width * HEATMAP_ROWS, sizeof(uint32_t));
+      if (st.heatmap == NULL)
+        err(EXIT_FAILURE, "calloc");
+    }
+
   fsync(dev_fd);
 
   if (!st.noflush)
@@ -3055,6 +7322,39 @@ main(int argc, char **argv)
         err(EXIT_FAILURE, NULL);
     }
 
+  if (profiles != NULL)
+    {
+      if (get_disk_model(dev_fd, model, sizeof(model)) != 0)
+        {
+          if (st.verbosity >= 0)
+            printf("Can't identify disk model, profiles not used%s\n",
+                CLEAR_LINE_END);
+          if (st.flog != NULL)
+            fprintf(st.flog, "disk model unknown, profiles not used\n");
+        }
+      else if (load_profile(&st, profiles, model) == 0)
+        {
+          if (st.verbosity >= 0)
+            printf("using profile of %s: %.0frpm, %ziMiB cache%s\n", model,
+                1000 / st.rotational_delay * 60, st.disk_cache_size,
+                CLEAR_LINE_END);
+          if (st.flog != NULL)
+            fprintf(st.flog, "Using profile of %s: %.0frpm disk with %ziMiB "
+                "cache, block thresholds: %.2f, %.2f, %.2f, %.2f, %.2f, "
+                "%.2f\n", model, 1000 / st.rotational_delay * 60,
+                st.disk_cache_size, st.vvfast_lvl, st.vfast_lvl,
+                st.fast_lvl, st.normal_lvl, st.slow_lvl, st.vslow_lvl);
+          calibrate = 0;
+        }
+      else if (!calibrate && st.verbosity >= 0)
+        printf("No profile of %s found, use --calibrate to create it%s\n",
+            model, CLEAR_LINE_END);
+    }
+
+  if (calibrate && calibrate_disk(&st, dev_fd) == 0 && profiles != NULL &&
+      model[0] != '\0')
+    save_profile(&st, profiles, model);
+
   if (st.verbosity > 2)
     {
       printf("min-reads: %zi, max re-reads: %zi, max rel std dev %f, "
@@ -3065,8 +7365,35 @@ main(int argc, char **argv)
          st.disk_cache_size);
     }
 
+  if (mlock_memory)
+    lock_memory(&st, block_info);
+
   clock_gettime(TIMER_TYPE, &times);
 
+  if (deadline > 0)
+    {
+      st.deadline.tv_sec = times.tv_sec + (time_t)deadline;
+      st.deadline.tv_nsec = times.tv_nsec +
+        (long)((deadline - floor(deadline)) * 1E9);
+      if (st.deadline.tv_nsec >= 1000000000L)
+        {
+          st.deadline.tv_sec++;
+          st.deadline.tv_nsec -= 1000000000L;
+        }
+      // leave a fifth of the time for re-reads
+      st.deadline_reserve = deadline / 5;
+    }
+
+  // let the user stop the test early and still get the report
+  struct sigaction stop_action;
+  memset(&stop_action, 0, sizeof(stop_action));
+  stop_action.sa_handler = stop_handler;
+  sigemptyset(&stop_action.sa_mask);
+  stop_action.sa_flags = SA_RESTART | SA_RESETHAND;
+  if (sigaction(SIGINT, &stop_action, NULL) < 0 ||
+      sigaction(SIGTERM, &stop_action, NULL) < 0)
+    err(EXIT_FAILURE, "sigaction");
+
   /*
    * MAIN LOOP
    */
@@ -3075,59 +7402,257 @@ main(int argc, char **argv)
   if (st.flog != NULL)
     fprintf(st.flog, "\nbegin testing: %s\n",
         asctime(localtime(&current_time)));
-  if(read_sectors_from_file == NULL)
+  set_metrics_phase(&st, METRICS_SCAN);
+  if (self_profile)
+    {
+      init_self_profile(&profile);
+      st.profile = &profile;
+    }
+  if (sample_fraction > 0 || sample_duration > 0)
+    {
+      /*
+       * SAMPLING
+       * estimate disk condition from random subset of blocks
+       */
+      read_sample(&st, dev_fd, block_info, st.dev_stat_path, sample_fraction,
+          sample_duration);
+
+      if (st.verbosity >= 0)
+        printf("\r%s\n", cursor_down(12));
+
+      clock_gettime(TIMER_TYPE, &timee);
+      diff_time(&res, times, timee);
+
+      print_sample_estimate(&st, block_info, res);
+
+      if (st.output != NULL)
+        write_to_file(&st, st.output, block_info, st.number_of_blocks);
+      if (heatmap != NULL)
+        write_heatmap(&st, heatmap);
+
+      stop_metrics(&st);
+      free(st.dev_stat_path);
+      for(size_t i=0; i< st.number_of_blocks; i++)
+        bi_clear(&block_info[i]);
+      free(block_info);
+      free_chunk_data(&st);
+      free(st.reread_buffer_free);
+      unlock_memory(&st);
+      if (st.flog != NULL)
+        {
+          fprintf(st.flog, "\nhdck log end");
+          fclose(st.flog);
+        }
+      return EXIT_SUCCESS;
+    }
+
+  if (errors_only)
+    {
+      /*
+       * ERRORS ONLY
+       * look for unreadable sectors without timing the reads
+       */
+      struct block_list_t* bad_list;
+
+      bad_list = scan_errors(&st, dev_fd, block_info);
+
+      if (st.verbosity >= 0)
+        printf("%s\nhdck results:%s\n"
+                   "=============%s\n", CLEAR_LINE, CLEAR_LINE_END,
+                   CLEAR_LINE_END);
+      if(st.flog != NULL)
+        fprintf(st.flog, "results:\n");
+
+      if (st.deadline_hit)
+        {
+          printf("%s, results are partial%s\n",
+              (stop_requested) ? "test interrupted" : "deadline reached",
+              CLEAR_LINE_END);
+          if (st.flog != NULL)
+            fprintf(st.flog, "%s, results are partial\n",
+                (stop_requested) ? "test interrupted" : "deadline reached");
+        }
+
+      if (bad_list == NULL)
+        {
+          bad_list = calloc(sizeof(struct block_list_t), 1);
+          if (bad_list == NULL)
+            err(EXIT_FAILURE, "calloc");
+
+          printf("no unreadable sectors found!%s\n", CLEAR_LINE_END);
+          if (st.flog != NULL)
+            fprintf(st.flog, "no unreadable sectors found!\n");
+        }
+
+      for (size_t i=0; !(bad_list[i].off == 0 && bad_list[i].len == 0); i++)
+        {
+          printf("unreadable sectors LBA: %lli-%lli%s\n",
+              (long long)bad_list[i].off,
+              (long long)(bad_list[i].off + bad_list[i].len - 1),
+              CLEAR_LINE_END);
+          if (st.flog != NULL)
+            fprintf(st.flog, "unreadable sectors LBA: %lli-%lli\n",
+                (long long)bad_list[i].off,
+                (long long)(bad_list[i].off + bad_list[i].len - 1));
+        }
+
+      if (st.write_uncertain_to_file != NULL)
+        write_ranges_to_file(st.write_uncertain_to_file, bad_list, 1);
+
+      if (st.tot_timeouts)
+        {
+          printf("Reads that timed out: %lli\n", st.tot_timeouts);
+          if (st.flog != NULL)
+            fprintf(st.flog, "Reads that timed out: %lli\n", st.tot_timeouts);
+        }
+
+      printf("\nDisk status: %s\n", (st.tot_errors || st.tot_timeouts) ?
+          "FAILED" : "no errors");
+      if (st.flog != NULL)
+        fprintf(st.flog, "\nDisk status: %s\n",
+            (st.tot_errors || st.tot_timeouts) ? "FAILED" : "no errors");
+
+      free(bad_list);
+      stop_metrics(&st);
+      free(st.dev_stat_path);
+      for(size_t i=0; i< st.number_of_blocks; i++)
+        bi_clear(&block_info[i]);
+      free(block_info);
+      free_chunk_data(&st);
+      free(st.reread_buffer_free);
+      unlock_memory(&st);
+      if (st.flog != NULL)
+        {
+          fprintf(st.flog, "\nhdck log end");
+          fclose(st.flog);
+        }
+      return EXIT_SUCCESS;
+    }
+
+  if(read_sectors_from_file == NULL && fs_extents == NULL)
     {
       read_whole_disk(&st, dev_fd, block_info, st.dev_stat_path, st.min_reads,
           st.sector_times, st.max_sectors, st.filesize);
+
+      map_skipped_regions(&st, dev_fd, block_info);
     }
   else
     {
-      struct block_list_t* block_list;
+      struct block_ranges_t block_list;
 
-      block_list = read_list_from_file(&st, read_sectors_from_file);
+      br_init(&block_list);
 
-      if(block_list == NULL)
+      if (read_sectors_from_file != NULL)
         {
-          printf("File \'%s\' is empty\n", read_sectors_from_file);
-          exit(EXIT_FAILURE);
+          if(read_list_from_file(&st, read_sectors_from_file,
+                &block_list) == 0)
+            {
+              printf("File \'%s\' is empty\n", read_sectors_from_file);
+              exit(EXIT_FAILURE);
+            }
+        }
+      else
+        {
+          if(read_fs_extents(&st, dev_fd, fs_extents, &block_list) == 0)
+            {
+              printf("No extents on %s found in \'%s\'\n", st.filename,
+                  fs_extents);
+              exit(EXIT_FAILURE);
+            }
+
+          if (st.flog != NULL)
+            fprintf(st.flog, "file system extents cover %lli of %lli "
+                "blocks\n", (long long)br_blocks(&block_list),
+                (long long)st.number_of_blocks);
         }
 
       for (size_t i=0; i < st.min_reads; i++)
-        read_block_list(&st, dev_fd, block_list, block_info, st.dev_stat_path,
-            st.number_of_blocks);
+        read_block_list(&st, dev_fd, &block_list, block_info,
+            st.dev_stat_path, st.number_of_blocks);
 
-      free(block_list);
+      br_free(&block_list);
     }
 
   if (st.verbosity >= 0)
-    printf("\r%s\n", cursor_down(18));
+    printf("\r%s\n", cursor_down(19));
 
   current_time = time(NULL);
   if(st.flog != NULL)
     fprintf(st.flog, "end of main loop: %s\n",
         asctime(localtime(&current_time)));
 
+  if (speed_profile != NULL)
+    {
+      FILE *handle = fopen(speed_profile, "w");
+      if (handle == NULL)
+        err(EXIT_FAILURE, "speed profile");
+      write_speed_profile(&st, handle);
+      fclose(handle);
+
+      if (st.flog != NULL)
+        {
+          fprintf(st.flog, "speed profile:\n");
+          write_speed_profile(&st, st.flog);
+          fprintf(st.flog, "\n");
+        }
+    }
+
+  if (st.zone_median != NULL && st.flog != NULL)
+    {
+      fprintf(st.flog, "zone baselines (ms):");
+      for (size_t i=0; i < ZONE_COUNT; i++)
+        fprintf(st.flog, "%s%.2f", (i % 8) ? " " : "\n", st.zone_median[i]);
+      fprintf(st.flog, "\n\n");
+    }
+
   /*
    * REREADS
    */
+  struct timespec reread_start, reread_end;
+  set_metrics_phase(&st, METRICS_REREAD);
+  clock_gettime(TIMER_TYPE, &reread_start);
   perform_re_reads(&st, dev_fd, st.dev_stat_path, block_info,
       st.number_of_blocks,
       st.max_reads, st.max_std_dev, st.min_reads, st.rotational_delay);
+  clock_gettime(TIMER_TYPE, &reread_end);
+  diff_time(&res, reread_start, reread_end);
+  st.reread_time = time_double(res);
+  set_metrics_phase(&st, METRICS_ANALYSIS);
 
   current_time = time(NULL);
   if(st.flog != NULL)
     fprintf(st.flog, "end of rereads: %s\n",
         asctime(localtime(&current_time)));
 
+  if (st.expand)
+    {
+      expand_suspect_blocks(&st, dev_fd, block_info);
+
+      current_time = time(NULL);
+      if(st.flog != NULL)
+        fprintf(st.flog, "end of neighbourhood probing: %s\n",
+            asctime(localtime(&current_time)));
+    }
+
+  if (st.zoom)
+    {
+      zoom_suspect_blocks(&st, dev_fd, block_info);
+
+      current_time = time(NULL);
+      if(st.flog != NULL)
+        fprintf(st.flog, "end of zooming: %s\n",
+            asctime(localtime(&current_time)));
+    }
+
   /*
    * REPORTING
    * print uncertain and bad blocks
    */
-  struct block_list_t* block_list;
+  struct block_ranges_t block_list;
 
-  block_list = find_bad_blocks(&st,
-      block_info, st.number_of_blocks, st.max_std_dev, st.min_reads, 1, 0,
-      st.rotational_delay, 0, 1);
+  br_init(&block_list);
+  find_bad_blocks(&st, block_info, st.number_of_blocks, st.max_std_dev,
+      st.min_reads, 1, 0, st.rotational_delay, 0, 1, &block_list);
 
   if (st.verbosity >= 0)
     printf("%s\nhdck results:%s\n"
@@ -3136,19 +7661,11 @@ main(int argc, char **argv)
   if(st.flog != NULL)
     fprintf(st.flog, "results:\n");
 
-  if (block_list == NULL)
+  if (block_list.len == 0)
     {
-
+      // zero out the file
       if (st.write_uncertain_to_file != NULL)
-        {
-          // zero out the file
-          block_list = calloc(sizeof(struct block_list_t), 1);
-
-          write_list_to_file(&st, st.write_uncertain_to_file, block_list);
-
-          free(block_list);
-          block_list = NULL;
-        }
+        write_list_to_file(&st, st.write_uncertain_to_file, &block_list);
 
       if (st.verbosity >= 0)
         printf("no problematic blocks found!%s\n", CLEAR_LINE_END);
@@ -3164,12 +7681,11 @@ main(int argc, char **argv)
         fprintf(st.flog, "possible latent bad sectors or silent "
             "realocations:\n");
 
-      size_t block_number=0;
-      while (!(block_list[block_number].off == 0 &&
-          block_list[block_number].len == 0))
+      for (size_t block_number=0; block_number < block_list.len;
+          block_number++)
         {
-          size_t start = block_list[block_number].off,
-                end = start + block_list[block_number].len;
+          size_t start = block_list.ranges[block_number].off,
+                end = start + block_list.ranges[block_number].len;
 
           for(size_t i= start; i< end; i++)
             {
@@ -3206,21 +7722,100 @@ main(int argc, char **argv)
                   bi_get_error(&block_info[i]),
                   bi_quantile(&block_info[i],9,10));
             }
-          block_number++;
         }
 
       fflush(stdout);
 
       if (st.verbosity >= 0)
-        printf("%zi uncertain blocks found%s\n", block_number,
+        printf("%zi uncertain blocks found%s\n", block_list.len,
             CLEAR_LINE_END);
       if (st.flog != NULL)
-        fprintf(st.flog, "%zi uncertain blocks found\n", block_number);
+        fprintf(st.flog, "%zi uncertain blocks found\n", block_list.len);
 
       if (st.write_uncertain_to_file != NULL)
-        write_list_to_file(&st, st.write_uncertain_to_file, block_list);
+        write_list_to_file(&st, st.write_uncertain_to_file, &block_list);
+    }
+
+  br_free(&block_list);
+
+  print_regions(&st, "regions not read because of dense read errors, "
+      "presumed bad:", &st.skipped);
+  print_regions(&st, "regions with read errors not scanned before the "
+      "deadline:", &st.unscanned);
+
+  if (st.zoomed_len > 0)
+    {
+      if (st.verbosity >= 0)
+        printf("slow and unreadable sectors (times in ms):%s\n",
+            CLEAR_LINE_END);
+      if (st.flog != NULL)
+        fprintf(st.flog, "slow and unreadable sectors (times in ms):\n");
+
+      for (size_t i=0; i < st.zoomed_len; i++)
+        {
+          struct block_info_t *times = &st.zoomed[i].times;
+          char desc[256];
+
+          if (bi_num_samples(times) == 0)
+            snprintf(desc, sizeof(desc), "unreadable, errors: %i, "
+                "timeouts: %i", bi_get_error(times), bi_get_timeout(times));
+          else
+            snprintf(desc, sizeof(desc), "min: %.2f, 1stQ: %.2f, "
+                "med: %.2f, 3rdQ: %.2f, max: %.2f, samples: %zi, errors: %i",
+                bi_min(times), bi_quantile(times, 1, 4),
+                bi_quantile(times, 2, 4), bi_quantile(times, 3, 4),
+                bi_max(times), bi_num_samples(times), bi_get_error(times));
+
+          if (st.verbosity >= 0)
+            printf("LBA: %lli-%lli %s%s\n", (long long)st.zoomed[i].lba,
+                (long long)(st.zoomed[i].lba + st.zoomed[i].len - 1), desc,
+                CLEAR_LINE_END);
+          if (st.flog != NULL)
+            fprintf(st.flog, "LBA: %lli-%lli %s\n",
+                (long long)st.zoomed[i].lba,
+                (long long)(st.zoomed[i].lba + st.zoomed[i].len - 1), desc);
+        }
+    }
+
+  if (st.damaged_len > 0)
+    {
+      if (st.verbosity >= 0)
+        printf("damaged areas around suspect blocks:%s\n", CLEAR_LINE_END);
+      if (st.flog != NULL)
+        fprintf(st.flog, "damaged areas around suspect blocks:\n");
+
+      for (size_t i=0; i < st.damaged_len; i++)
+        {
+          if (st.verbosity >= 0)
+            printf("LBA: %lli-%lli%s\n", (long long)st.damaged[i].off,
+                (long long)(st.damaged[i].off + st.damaged[i].len - 1),
+                CLEAR_LINE_END);
+          if (st.flog != NULL)
+            fprintf(st.flog, "LBA: %lli-%lli\n", (long long)st.damaged[i].off,
+                (long long)(st.damaged[i].off + st.damaged[i].len - 1));
+        }
+    }
+
+  if (st.deadline_hit)
+    {
+      if (st.verbosity >= 0)
+        printf("%s, results are partial%s\n",
+            (stop_requested) ? "test interrupted" : "deadline reached",
+            CLEAR_LINE_END);
+      if (st.flog != NULL)
+        fprintf(st.flog, "%s, results are partial\n",
+            (stop_requested) ? "test interrupted" : "deadline reached");
 
-      free(block_list);
+      if (st.state_file != NULL)
+        {
+          write_state_to_file(&st, st.state_file, block_info);
+          if (st.verbosity >= 0)
+            printf("unfinished ranges saved to %s%s\n", st.state_file,
+                CLEAR_LINE_END);
+          if (st.flog != NULL)
+            fprintf(st.flog, "unfinished ranges saved to %s\n",
+                st.state_file);
+        }
     }
 
   clock_gettime(TIMER_TYPE, &timee);
@@ -3236,6 +7831,24 @@ main(int argc, char **argv)
         res.tv_nsec/1000000, res.tv_nsec/1000%1000,
         res.tv_nsec%1000);
 
+  // the report is written while results are printed, so that block_info
+  // doesn't have to be traversed again for it
+  struct json_writer_t json_writer, *json = NULL;
+  if (json_handle != NULL)
+    {
+      json = &json_writer;
+      json_init(json, json_handle);
+      json_begin_object(json, NULL);
+      json_string(json, "device", st.filename);
+      json_int(json, "sectors_per_block", st.sectors);
+      json_int(json, "number_of_blocks", st.number_of_blocks);
+      json_bool(json, "quick", st.quick);
+      json_bool(json, "deadline_reached", st.deadline_hit && !stop_requested);
+      json_bool(json, "interrupted", stop_requested);
+      json_double(json, "wall_time_s", time_double(res));
+      json_begin_array(json, "bad_blocks");
+    }
+
   long double sum = 0.0;
   long long reads = 0;
   struct block_info_t single_block;
@@ -3244,17 +7857,31 @@ main(int argc, char **argv)
 
   for (size_t i=0; i < st.number_of_blocks; i++)
     {
+      if (json != NULL &&
+          (bi_get_error(&block_info[i]) || bi_get_timeout(&block_info[i])))
+        json_write_bad_block(json, &st, block_info, i);
       if (!bi_is_initialised(&block_info[i]))
         continue;
       sum += bi_sum(&block_info[i]);
       reads += bi_num_samples(&block_info[i]);
 
-      if (bi_num_samples(&block_info[i]) < 5)
+      // unreadable blocks have no time to average
+      if (bi_num_samples(&block_info[i]) == 0)
+        continue;
+      else if (bi_num_samples(&block_info[i]) < 5)
         bi_add_time(&single_block, bi_average(&block_info[i]));
       else
         bi_add_time(&single_block, bi_trunc_average(&block_info[i], 0.25));
     }
 
+  // same total as printed below, st.tot_sum also counts discarded samples
+  if (json != NULL)
+    {
+      json_end_array(json);
+      json_int(json, "samples", reads);
+      json_double(json, "sum_time_ms", sum);
+    }
+
   double sec = floor(sum / 1000);
   double msec = floor(sum - sec * 1000);
   double usec = floor((sum - sec * 1000 - msec)*1000);
@@ -3302,6 +7929,12 @@ main(int argc, char **argv)
     fprintf(st.flog, "std dev: %.9f(ms)\n",
         bi_stdev(&single_block));
 
+  if (json != NULL)
+    {
+      json_double(json, "mean_block_time_ms", sum);
+      json_double(json, "std_dev_ms", bi_stdev(&single_block));
+    }
+
   bi_clear(&single_block);
 
   update_block_stats(&st, block_info);
@@ -3318,31 +7951,63 @@ main(int argc, char **argv)
   if (st.flog != NULL)
     fprintf(st.flog, "Number of interrupted reads: %lli\n", st.tot_interrupts);
 
+  if (st.verbosity >= 0)
+    printf("Number of reads that timed out: %lli\n", st.tot_timeouts);
+  if (st.flog != NULL)
+    fprintf(st.flog, "Number of reads that timed out: %lli\n",
+        st.tot_timeouts);
+
+  if (st.sample_pool != NULL)
+    {
+      if (st.verbosity >= 0)
+        printf("Page faults during timed reads: %lli\n", st.scan_faults);
+      if (st.flog != NULL)
+        fprintf(st.flog, "Page faults during timed reads: %lli\n",
+            st.scan_faults);
+
+      // more loops than min_reads need to allocate memory for samples
+      if (st.verbosity >= 0)
+        printf("Blocks that outgrew preallocated storage during timed "
+            "reads: %lli\n", st.scan_spills);
+      if (st.flog != NULL)
+        fprintf(st.flog, "Blocks that outgrew preallocated storage during "
+            "timed reads: %lli\n", st.scan_spills);
+    }
+
+  if (st.profile != NULL)
+    {
+      if (st.verbosity >= 0)
+        print_self_profile(&st, stdout);
+      if (st.flog != NULL)
+        print_self_profile(&st, st.flog);
+    }
+
   if (st.verbosity >= 0)
     printf("Individual block statistics:\n<%02.2fms: %lli\n"
         "<%02.2fms: %lli\n<%2.2fms: %lli\n<%2.2fms: %lli\n<%2.2fms: %lli\n"
-        "<%2.2fms: %lli\n>%2.2fms: %lli\nERR: %lli\n",
+        "<%2.2fms: %lli\n>%2.2fms: %lli\nERR: %lli\nTIMEOUT: %lli\n",
       st.vvfast_lvl, st.vvfast, st.vfast_lvl, st.vfast,
       st.fast_lvl, st.fast, st.normal_lvl, st.normal,
       st.slow_lvl, st.slow, st.vslow_lvl, st.vslow,
-      st.vslow_lvl, st.vvslow, st.errors);
+      st.vslow_lvl, st.vvslow, st.errors, st.timeouts);
   if (st.flog != NULL)
     fprintf(st.flog, "Individual block statistics:\n<%02.2fms: %lli\n"
         "<%02.2fms: %lli\n<%2.2fms: %lli\n<%2.2fms: %lli\n<%2.2fms: %lli\n"
-        "<%2.2fms: %lli\n>%2.2fms: %lli\nERR: %lli\n",
+        "<%2.2fms: %lli\n>%2.2fms: %lli\nERR: %lli\nTIMEOUT: %lli\n",
       st.vvfast_lvl, st.vvfast, st.vfast_lvl, st.vfast,
       st.fast_lvl, st.fast, st.normal_lvl, st.normal,
       st.slow_lvl, st.slow, st.vslow_lvl, st.vslow,
-      st.vslow_lvl, st.vvslow, st.errors);
+      st.vslow_lvl, st.vvslow, st.errors, st.timeouts);
 
   if (st.verbosity >= 0)
     printf("%s\n", CLEAR_LINE_END);
   if (st.flog != NULL)
     fprintf(st.flog, "\n");
 
-  struct block_list_t *worst_blocks;
-  worst_blocks = find_worst_blocks(&st, block_info, st.number_of_blocks,
-      10);
+  struct block_ranges_t worst_blocks;
+
+  br_init(&worst_blocks);
+  find_worst_blocks(&st, block_info, st.number_of_blocks, 10, &worst_blocks);
 
   if (st.verbosity >= 0)
     printf("Worst blocks:%s\n", CLEAR_LINE_END);
@@ -3355,15 +8020,19 @@ main(int argc, char **argv)
     fprintf(st.flog, "block no      st.dev  avg   1stQ     med     3rdQ  valid "
         "samples 9th decile\n");
 
-  size_t block_number=0;
-  while (!(worst_blocks[block_number].off == 0 &&
-      worst_blocks[block_number].len == 0))
+  if (json != NULL)
+    json_begin_array(json, "worst_blocks");
+
+  for (size_t block_number=0; block_number < worst_blocks.len;
+      block_number++)
     {
-      size_t start = worst_blocks[block_number].off,
-            end = start + worst_blocks[block_number].len;
+      size_t start = worst_blocks.ranges[block_number].off,
+            end = start + worst_blocks.ranges[block_number].len;
 
       for(size_t i= start; i< end; i++)
         {
+          if (json != NULL)
+            json_write_worst_block(json, &st, block_info, i);
 
           if (bi_get_error(&block_info[i]))
             {
@@ -3412,116 +8081,42 @@ main(int argc, char **argv)
                 bi_quantile(&block_info[i],9,10)
                 );
         }
-      block_number++;
     }
 
-  free(worst_blocks);
+  br_free(&worst_blocks);
+
+  if (json != NULL)
+    json_end_array(json);
 
   if (st.verbosity >= 0)
     printf("%s\n", CLEAR_LINE_END);
   if (st.flog != NULL)
     fprintf(st.flog, "\n");
 
-  printf("Disk status: ");
+  const char *status, *status_desc;
 
-  if (st.flog != NULL)
-    fprintf(st.flog, "\nDisk status: ");
+  status = get_disk_status(&st, &status_desc);
 
-  if (st.errors != 0)
-    {
-      printf("FAILED\n"
-          "CAUTION! Bad sectors detected, copy data off this "
-          "disk AS SOON AS POSSIBLE!\n");
-      if (st.flog != NULL)
-        fprintf(st.flog, "FAILED\n"
-            "CAUTION! Bad sectors detected, copy data off this "
-            "disk AS SOON AS POSSIBLE!\n");
-    }
-  else if (st.vvslow != 0)
-    {
-      printf("CRITICAL\n"
-          "CAUTION! Sectors that required more than 6 read "
-          "attempts detected, drive may be ALREADY FAILING!\n");
-      if (st.flog != NULL)
-        fprintf(st.flog, "CRITICAL\n"
-            "CAUTION! Sectors that required more than 6 read "
-            "attempts detected, drive may be ALREADY FAILING!\n");
-    }
-  else if (st.vslow != 0)
-    {
-      printf("very bad\n"
-          "sectors that required more than 4 read attempts "
-          "detected!\n");
-      if (st.flog != NULL)
-        fprintf(st.flog, "very bad\n"
-            "sectors that required more than 4 read attempts "
-            "detected!\n");
-    }
-  else if (st.slow != 0)
-    {
-      if (!st.quick || st.exclusive)
-        {
-          printf("bad\n"
-              "sectors that required more than 2 read attempts "
-              "detected\n");
-          if (st.flog != NULL)
-            fprintf(st.flog, "bad\n"
-                "sectors that required more than 2 read attempts "
-                "detected\n");
-        }
-      else
-        {
-          printf("moderate\n"
-              "sectors that required more than 2 read attempts "
-              "detected\n");
-          if (st.flog != NULL)
-            fprintf(st.flog, "moderate\n"
-                "sectors that required more than 2 read attempts "
-                "detected\n");
-        }
-    }
-  else if (((st.normal * 1.0) / (st.number_of_blocks * 1.0) > 0.001
-              && !st.quick)
-      || ((st.normal * 1.0) / (st.number_of_blocks * 1.0) > 0.25
-          && st.quick))
+  printf("Disk status: %s\n", status);
+  if (status_desc != NULL)
+    printf("%s\n", status_desc);
+
+  if (st.flog != NULL)
     {
-      printf("moderate\n"
-          "high number of blocks that required more than 1 "
-          "read attempt detected\n");
-      if (st.flog != NULL)
-        fprintf(st.flog, "moderate\n"
-            "high number of blocks that required more than 1 "
-            "read attempt detected\n");
+      fprintf(st.flog, "\nDisk status: %s\n", status);
+      if (status_desc != NULL)
+        fprintf(st.flog, "%s\n", status_desc);
     }
-  else if (st.normal == 0)
-    {
-      if ((st.fast * 1.0) / (st.number_of_blocks * 1.0) < 0.1)
-        {
-          printf("excellent\n");
-          if (st.flog != NULL)
-            fprintf(st.flog, "excellent\n");
-        }
-      else
-        {
-          printf("very good\n"
-            "no blocks that required constant re-reads "
-            "detected\n");
 
-          if (st.flog != NULL)
-            fprintf(st.flog, "very good\n"
-              "no blocks that required constant re-reads "
-              "detected\n");
-        }
-    }
-  else
+  if (json != NULL)
     {
-      printf("good\n"
-          "few blocks that required more than 1 read attempt "
-          "detected\n");
-      if (st.flog != NULL)
-        fprintf(st.flog, "good\n"
-          "few blocks that required more than 1 read attempt "
-          "detected\n");
+      json_string(json, "status", status);
+      json_string(json, "status_description", status_desc);
+      json_write_buckets(json, &st);
+      json_write_profile(json, &st);
+      json_end_object(json);
+      if (fclose(json_handle) != 0)
+        err(EXIT_FAILURE, "%s", json_file);
     }
 
   if (st.verbosity > 2)
@@ -3560,11 +8155,28 @@ main(int argc, char **argv)
     {
       write_to_file(&st, st.output, block_info, st.number_of_blocks);
     }
+  if (heatmap != NULL)
+    write_heatmap(&st, heatmap);
+
+  stop_metrics(&st);
 
   free(st.dev_stat_path);
+  br_free(&st.skipped);
+  br_free(&st.unscanned);
+  free(st.damaged);
+  free(st.zone_median);
+  free(st.speed);
+  free(st.heatmap);
+  free(st.loop_times);
+  for (size_t i=0; i < st.zoomed_len; i++)
+    bi_clear(&st.zoomed[i].times);
+  free(st.zoomed);
   for(size_t i=0; i< st.number_of_blocks; i++)
     bi_clear(&block_info[i]);
   free(block_info);
+  free_chunk_data(&st);
+  free(st.reread_buffer_free);
+  unlock_memory(&st);
   if (st.verbosity >= 0)
     printf("\n");
   if (st.flog != NULL)
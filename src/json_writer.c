@@ -0,0 +1,195 @@
+/** hdck - hard drive low-level error and badsector checking
+ *
+ * Copyright (C) 2010  Hubert Kario
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <stdio.h>
+#include <math.h>
+#include <err.h>
+#include <stdlib.h>
+#include "json_writer.h"
+
+/**
+ * write escaped string
+ */
+static void
+json_string_value(struct json_writer_t* json, const char* value)
+{
+  fputc('"', json->file);
+  for (const unsigned char *c = (const unsigned char *)value; *c; c++)
+    {
+      if (*c == '"' || *c == '\\')
+        fprintf(json->file, "\\%c", *c);
+      else if (*c == '\n')
+        fputs("\\n", json->file);
+      else if (*c < 0x20)
+        fprintf(json->file, "\\u%04x", *c);
+      else
+        fputc(*c, json->file);
+    }
+  fputc('"', json->file);
+}
+
+/**
+ * write separator, indentation and key of a new member
+ */
+static void
+json_member(struct json_writer_t* json, const char* key)
+{
+  if (json->depth > 0)
+    {
+      if (!json->empty[json->depth - 1])
+        fputc(',', json->file);
+      json->empty[json->depth - 1] = 0;
+      fputc('\n', json->file);
+    }
+
+  for (int i=0; i < json->depth; i++)
+    fputs("  ", json->file);
+
+  if (key != NULL)
+    {
+      json_string_value(json, key);
+      fputs(": ", json->file);
+    }
+}
+
+/**
+ * start an object or array
+ */
+static void
+json_begin(struct json_writer_t* json, const char* key, char bracket)
+{
+  if (json->depth >= JSON_MAX_DEPTH)
+    errx(EXIT_FAILURE, "json: document nested too deep");
+
+  json_member(json, key);
+  fputc(bracket, json->file);
+  json->empty[json->depth++] = 1;
+}
+
+/**
+ * finish an object or array
+ */
+static void
+json_end(struct json_writer_t* json, char bracket)
+{
+  if (json->depth <= 0)
+    errx(EXIT_FAILURE, "json: no object or array to end");
+
+  json->depth--;
+  if (!json->empty[json->depth])
+    {
+      fputc('\n', json->file);
+      for (int i=0; i < json->depth; i++)
+        fputs("  ", json->file);
+    }
+  fputc(bracket, json->file);
+  if (json->depth == 0)
+    fputc('\n', json->file);
+}
+
+/**
+ * initialises the writer, does not write anything
+ */
+void
+json_init(struct json_writer_t* json, FILE* file)
+{
+  json->file = file;
+  json->depth = 0;
+}
+
+/**
+ * start an object
+ */
+void
+json_begin_object(struct json_writer_t* json, const char* key)
+{
+  json_begin(json, key, '{');
+}
+
+/**
+ * finish last started object
+ */
+void
+json_end_object(struct json_writer_t* json)
+{
+  json_end(json, '}');
+}
+
+/**
+ * start an array
+ */
+void
+json_begin_array(struct json_writer_t* json, const char* key)
+{
+  json_begin(json, key, '[');
+}
+
+/**
+ * finish last started array
+ */
+void
+json_end_array(struct json_writer_t* json)
+{
+  json_end(json, ']');
+}
+
+/**
+ * write a string, NULL is written as null
+ */
+void
+json_string(struct json_writer_t* json, const char* key, const char* value)
+{
+  json_member(json, key);
+  if (value == NULL)
+    fputs("null", json->file);
+  else
+    json_string_value(json, value);
+}
+
+/**
+ * write an integer
+ */
+void
+json_int(struct json_writer_t* json, const char* key, long long value)
+{
+  json_member(json, key);
+  fprintf(json->file, "%lli", value);
+}
+
+/**
+ * write a floating point number, infinities and NaN are written as null
+ */
+void
+json_double(struct json_writer_t* json, const char* key, double value)
+{
+  json_member(json, key);
+  // enough digits for the value to read back exactly
+  if (isfinite(value))
+    fprintf(json->file, "%.17g", value);
+  else
+    fputs("null", json->file);
+}
+
+/**
+ * write a boolean
+ */
+void
+json_bool(struct json_writer_t* json, const char* key, int value)
+{
+  json_member(json, key);
+  fputs(value ? "true" : "false", json->file);
+}
@@ -0,0 +1,91 @@
+/** hdck - hard drive low-level error and badsector checking
+ *
+ * Copyright (C) 2010  Hubert Kario
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#ifndef __JSON_WRITER_H
+#define __JSON_WRITER_H 1
+
+#include <stdio.h>
+
+/// maximal nesting of objects and arrays
+#define JSON_MAX_DEPTH 16
+
+/// state of a JSON document being written out
+struct json_writer_t {
+    FILE* file; ///< file the document is written to
+    int depth; ///< number of currently open objects and arrays
+    char empty[JSON_MAX_DEPTH]; ///< whether the object or array on given
+                                /// level doesn't have any members yet
+};
+
+/**
+ * initialises the writer, does not write anything
+ */
+void
+json_init(struct json_writer_t* json, FILE* file);
+
+/**
+ * start an object
+ * @param key name of the member in enclosing object, NULL in arrays and for
+ * the top level object
+ */
+void
+json_begin_object(struct json_writer_t* json, const char* key);
+
+/**
+ * finish last started object
+ */
+void
+json_end_object(struct json_writer_t* json);
+
+/**
+ * start an array
+ * @param key name of the member in enclosing object, NULL in arrays
+ */
+void
+json_begin_array(struct json_writer_t* json, const char* key);
+
+/**
+ * finish last started array
+ */
+void
+json_end_array(struct json_writer_t* json);
+
+/**
+ * write a string, NULL is written as null
+ */
+void
+json_string(struct json_writer_t* json, const char* key, const char* value);
+
+/**
+ * write an integer
+ */
+void
+json_int(struct json_writer_t* json, const char* key, long long value);
+
+/**
+ * write a floating point number, infinities and NaN are written as null
+ */
+void
+json_double(struct json_writer_t* json, const char* key, double value);
+
+/**
+ * write a boolean
+ */
+void
+json_bool(struct json_writer_t* json, const char* key, int value);
+
+#endif
@@ -0,0 +1,580 @@
+/** hdck - hard drive low-level error and badsector checking
+ *
+ * Copyright (C) 2010  Hubert Kario
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#define _GNU_SOURCE 1
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <err.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include "ioprio.h"
+#include "metrics.h"
+
+/// names of block speed classes, used as labels
+static const char *class_names[METRICS_CLASSES] = {
+    "vvfast", "vfast", "fast", "normal", "slow", "vslow", "vvslow"
+};
+
+/// names of test phases, used as labels
+static const char *phase_names[] = {
+    "starting", "scan", "reread", "analysis", "done"
+};
+
+/// latency quantiles exported
+static const double quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+
+/**
+ * return current time in seconds
+ */
+static double
+metrics_now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1E9;
+}
+
+/**
+ * return histogram bin for read time
+ */
+int
+metrics_latency_bin(double time)
+{
+  int bin;
+
+  if (time <= METRICS_MIN_LATENCY)
+    return 0;
+
+  bin = (int)(log10(time / METRICS_MIN_LATENCY) * METRICS_BINS_PER_DECADE);
+  if (bin > METRICS_LATENCY_BINS - 1)
+    bin = METRICS_LATENCY_BINS - 1;
+  return bin;
+}
+
+/**
+ * return upper bound of the histogram bin containing q-quantile, in ms
+ */
+static double
+metrics_quantile(const struct metrics_snapshot_t* snapshot, double q)
+{
+  long long count = 0, seen = 0;
+
+  for (int i=0; i < METRICS_LATENCY_BINS; i++)
+    count += snapshot->latency[i];
+
+  if (count == 0)
+    return NAN;
+
+  for (int i=0; i < METRICS_LATENCY_BINS; i++)
+    {
+      seen += snapshot->latency[i];
+      if (seen >= q * count)
+        return METRICS_MIN_LATENCY *
+          pow(10, (i + 1) * 1.0 / METRICS_BINS_PER_DECADE);
+    }
+
+  return INFINITY;
+}
+
+/**
+ * write metric header
+ */
+static void
+metrics_header(FILE* out, const char* name, const char* type,
+    const char* help)
+{
+  fprintf(out, "# HELP hdck_%s %s\n# TYPE hdck_%s %s\n", name, help, name,
+      type);
+}
+
+/**
+ * write snapshot in Prometheus text exposition format
+ */
+static void
+metrics_write(struct metrics_t* metrics,
+    const struct metrics_snapshot_t* snapshot,
+    const struct metrics_progress_t* progress, FILE* out)
+{
+  const char *dev = metrics->device;
+  double elapsed = metrics_now() - metrics->start;
+  long long count = 0;
+
+  metrics_header(out, "phase", "gauge", "Part of the test running");
+  for (int i=METRICS_STARTING; i <= METRICS_DONE; i++)
+    fprintf(out, "hdck_phase{device=\"%s\",phase=\"%s\"} %i\n", dev,
+        phase_names[i], snapshot->phase == i);
+
+  metrics_header(out, "loop", "gauge", "Current main loop");
+  fprintf(out, "hdck_loop{device=\"%s\"} %lli\n", dev, snapshot->loop);
+  metrics_header(out, "loops", "gauge", "Number of main loops to perform");
+  fprintf(out, "hdck_loops{device=\"%s\"} %lli\n", dev, snapshot->loops);
+
+  metrics_header(out, "current_lba", "gauge", "Sector read most recently");
+  fprintf(out, "hdck_current_lba{device=\"%s\"} %lli\n", dev, snapshot->lba);
+  metrics_header(out, "disk_sectors", "gauge", "Size of the disk in sectors");
+  fprintf(out, "hdck_disk_sectors{device=\"%s\"} %lli\n", dev,
+      snapshot->disk_sectors);
+
+  metrics_header(out, "progress_ratio", "gauge",
+      "Completed part of current phase");
+  fprintf(out, "hdck_progress_ratio{device=\"%s\"} %.6f\n", dev,
+      snapshot->progress);
+  metrics_header(out, "elapsed_seconds", "gauge", "Time since test start");
+  fprintf(out, "hdck_elapsed_seconds{device=\"%s\"} %.3f\n", dev, elapsed);
+  metrics_header(out, "eta_seconds", "gauge",
+      "Expected time to the end of current phase");
+  fprintf(out, "hdck_eta_seconds{device=\"%s\"} %.0f\n", dev,
+      progress->eta);
+
+  metrics_header(out, "read_bytes_total", "counter", "Amount of data read");
+  fprintf(out, "hdck_read_bytes_total{device=\"%s\"} %lli\n", dev,
+      snapshot->bytes_read);
+  metrics_header(out, "read_speed_mib_per_second", "gauge",
+      "Read speed since previous refresh");
+  fprintf(out, "hdck_read_speed_mib_per_second{device=\"%s\"} %.3f\n", dev,
+      progress->speed);
+
+  metrics_header(out, "class_threshold_milliseconds", "gauge",
+      "Upper bound of read time of block speed class");
+  for (int i=0; i < METRICS_CLASSES - 1; i++)
+    fprintf(out, "hdck_class_threshold_milliseconds{device=\"%s\","
+        "class=\"%s\"} %.3f\n", dev, class_names[i], snapshot->thresholds[i]);
+
+  metrics_header(out, "reads_total", "counter",
+      "Number of reads in every speed class");
+  for (int i=0; i < METRICS_CLASSES; i++)
+    fprintf(out, "hdck_reads_total{device=\"%s\",class=\"%s\"} %lli\n", dev,
+        class_names[i], snapshot->reads[i]);
+
+  metrics_header(out, "blocks", "gauge",
+      "Number of blocks in every speed class (by 9th decile), with read "
+      "errors and with reads that timed out");
+  for (int i=0; i < METRICS_CLASSES; i++)
+    fprintf(out, "hdck_blocks{device=\"%s\",class=\"%s\"} %lli\n", dev,
+        class_names[i], snapshot->blocks[i]);
+  fprintf(out, "hdck_blocks{device=\"%s\",class=\"error\"} %lli\n", dev,
+      snapshot->error_blocks);
+  fprintf(out, "hdck_blocks{device=\"%s\",class=\"timeout\"} %lli\n", dev,
+      snapshot->timeout_blocks);
+
+  metrics_header(out, "read_errors_total", "counter", "Number of read errors");
+  fprintf(out, "hdck_read_errors_total{device=\"%s\"} %lli\n", dev,
+      snapshot->errors);
+  metrics_header(out, "read_timeouts_total", "counter",
+      "Number of reads that timed out");
+  fprintf(out, "hdck_read_timeouts_total{device=\"%s\"} %lli\n", dev,
+      snapshot->timeouts);
+  metrics_header(out, "interrupted_reads_total", "counter",
+      "Number of reads interrupted by other disk activity");
+  fprintf(out, "hdck_interrupted_reads_total{device=\"%s\"} %lli\n", dev,
+      snapshot->interrupts);
+  metrics_header(out, "invalid_blocks", "gauge",
+      "Number of blocks with useless data");
+  fprintf(out, "hdck_invalid_blocks{device=\"%s\"} %lli\n", dev,
+      snapshot->invalid);
+
+  metrics_header(out, "read_latency_milliseconds", "summary",
+      "Block read time");
+  for (size_t i=0; i < sizeof(quantiles)/sizeof(quantiles[0]); i++)
+    fprintf(out, "hdck_read_latency_milliseconds{device=\"%s\","
+        "quantile=\"%g\"} %.3f\n", dev, quantiles[i],
+        metrics_quantile(snapshot, quantiles[i]));
+  for (int i=0; i < METRICS_LATENCY_BINS; i++)
+    count += snapshot->latency[i];
+  fprintf(out, "hdck_read_latency_milliseconds_sum{device=\"%s\"} %.3f\n",
+      dev, snapshot->latency_sum);
+  fprintf(out, "hdck_read_latency_milliseconds_count{device=\"%s\"} %lli\n",
+      dev, count);
+}
+
+/**
+ * derive elapsed time, ETA and read speed from snapshot, needs to be called
+ * with the snapshot locked
+ */
+static void
+metrics_update(struct metrics_t* metrics,
+    const struct metrics_snapshot_t* snapshot, struct metrics_rate_t* rate,
+    struct metrics_progress_t* progress)
+{
+  double now = metrics_now();
+
+  // phases can read the same list of blocks many times, progress going
+  // back means the next read of it started
+  if (snapshot->progress < metrics->last_progress)
+    {
+      metrics->phase_start = now;
+      metrics->phase_bytes = snapshot->bytes_read;
+    }
+  metrics->last_progress = snapshot->progress;
+
+  if (now > rate->time)
+    rate->speed = (snapshot->bytes_read - rate->bytes) / 1048576.0 /
+      (now - rate->time);
+  rate->time = now;
+  rate->bytes = snapshot->bytes_read;
+
+  progress->elapsed = now - metrics->phase_start;
+  progress->speed = rate->speed;
+  progress->average_speed = (progress->elapsed > 0) ?
+    (snapshot->bytes_read - metrics->phase_bytes) / 1048576.0 /
+    progress->elapsed : 0;
+  if (snapshot->phase == METRICS_DONE)
+    progress->eta = 0;
+  else if (snapshot->progress > 0)
+    progress->eta = progress->elapsed * (1 - snapshot->progress) /
+      snapshot->progress;
+  else
+    progress->eta = NAN;
+}
+
+/**
+ * copy last published snapshot and derive progress from it
+ */
+static void
+metrics_refresh(struct metrics_t* metrics,
+    struct metrics_snapshot_t* snapshot, struct metrics_rate_t* rate,
+    struct metrics_progress_t* progress)
+{
+  pthread_mutex_lock(&metrics->lock);
+  memcpy(snapshot, &metrics->snapshot, sizeof(struct metrics_snapshot_t));
+  metrics_update(metrics, snapshot, rate, progress);
+  pthread_mutex_unlock(&metrics->lock);
+}
+
+/**
+ * draw status of the test
+ *
+ * The snapshot stays locked while drawing, so that the I/O thread can wait
+ * with its own terminal output until the status is complete.
+ */
+static void
+metrics_render(struct metrics_t* metrics)
+{
+  struct metrics_snapshot_t snapshot;
+  struct metrics_progress_t progress;
+
+  pthread_mutex_lock(&metrics->lock);
+  memcpy(&snapshot, &metrics->snapshot, sizeof(struct metrics_snapshot_t));
+  metrics_update(metrics, &snapshot, &metrics->render_rate, &progress);
+
+  if (snapshot.display != METRICS_DISPLAY_NONE)
+    {
+      flockfile(stdout);
+      metrics->render(&snapshot, &progress);
+      fflush(stdout);
+      funlockfile(stdout);
+    }
+  pthread_mutex_unlock(&metrics->lock);
+}
+
+/**
+ * atomically replace the textfile with current metrics
+ */
+static void
+metrics_write_textfile(struct metrics_t* metrics,
+    const struct metrics_snapshot_t* snapshot,
+    const struct metrics_progress_t* progress)
+{
+  char *tmp;
+  FILE *out;
+
+  if (asprintf(&tmp, "%s.tmp", metrics->textfile) < 0)
+    err(EXIT_FAILURE, "metrics");
+
+  out = fopen(tmp, "w");
+  if (out == NULL)
+    {
+      warn("metrics: %s", tmp);
+      free(tmp);
+      return;
+    }
+  metrics_write(metrics, snapshot, progress, out);
+  if (fclose(out) != 0 || rename(tmp, metrics->textfile) != 0)
+    warn("metrics: %s", metrics->textfile);
+  free(tmp);
+}
+
+/**
+ * send current metrics to a client of the socket
+ */
+static void
+metrics_serve(struct metrics_t* metrics,
+    const struct metrics_snapshot_t* snapshot,
+    const struct metrics_progress_t* progress)
+{
+  struct timeval tv = { 1, 0 };
+  FILE *out;
+  int fd;
+
+  fd = accept(metrics->listen_fd, NULL, NULL);
+  if (fd < 0)
+    return;
+
+  // don't let a stuck client stop refreshing of the textfile
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+  out = fdopen(fd, "w");
+  if (out == NULL)
+    {
+      close(fd);
+      return;
+    }
+  metrics_write(metrics, snapshot, progress, out);
+  fclose(out);
+}
+
+/**
+ * lower priority of the calling thread and move it off the test CPU
+ */
+static void
+metrics_lower_priority(void)
+{
+  struct sched_param sp;
+  cpu_set_t cpu_set;
+
+  sp.sched_priority = 0;
+  sched_setscheduler(0, SCHED_IDLE, &sp);
+  setpriority(PRIO_PROCESS, syscall(SYS_gettid), 19);
+  ioprio_set(IOPRIO_WHO_PROCESS, 0, IOPRIO_PRIO_VALUE(IOPRIO_CLASS_IDLE, 0));
+
+  // the test runs on the first CPU
+  if (sched_getaffinity(0, sizeof(cpu_set_t), &cpu_set) == 0 &&
+      CPU_COUNT(&cpu_set) > 1)
+    {
+      CPU_CLR(0, &cpu_set);
+      sched_setaffinity(0, sizeof(cpu_set_t), &cpu_set);
+    }
+}
+
+/**
+ * return poll() timeout until the deadline
+ */
+static int
+metrics_timeout(double deadline)
+{
+  double now = metrics_now();
+
+  if (isinf(deadline))
+    return -1;
+  if (deadline <= now)
+    return 0;
+  return (int)((deadline - now) * 1000) + 1;
+}
+
+/**
+ * body of the metrics thread
+ */
+static void *
+metrics_thread(void* arg)
+{
+  struct metrics_t* metrics = arg;
+  struct metrics_snapshot_t snapshot;
+  struct metrics_progress_t progress;
+  struct pollfd fds[2];
+  double next_textfile = INFINITY, next_render = INFINITY;
+
+  metrics_lower_priority();
+
+  if (metrics->textfile != NULL)
+    next_textfile = metrics_now();
+  if (metrics->render != NULL)
+    next_render = metrics_now() + metrics->render_interval;
+
+  fds[0].fd = metrics->wakeup[0];
+  fds[0].events = POLLIN;
+  fds[1].fd = metrics->listen_fd;
+  fds[1].events = POLLIN;
+
+  while (1)
+    {
+      double next = (next_textfile < next_render) ? next_textfile :
+        next_render;
+      int ret;
+
+      ret = poll(fds, (metrics->listen_fd < 0) ? 1 : 2,
+          metrics_timeout(next));
+      if (ret < 0 && errno != EINTR)
+        err(EXIT_FAILURE, "metrics: poll");
+
+      if (fds[0].revents & POLLIN)
+        break;
+
+      if (metrics->listen_fd >= 0 && (fds[1].revents & POLLIN))
+        {
+          metrics_refresh(metrics, &snapshot, &metrics->socket_rate,
+              &progress);
+          metrics_serve(metrics, &snapshot, &progress);
+        }
+
+      if (metrics_now() >= next_render)
+        {
+          next_render += metrics->render_interval;
+          // don't try to catch up after the thread was starved
+          if (next_render < metrics_now())
+            next_render = metrics_now() + metrics->render_interval;
+          metrics_render(metrics);
+        }
+
+      if (metrics_now() >= next_textfile)
+        {
+          next_textfile += metrics->interval;
+          if (next_textfile < metrics_now())
+            next_textfile = metrics_now() + metrics->interval;
+          metrics_refresh(metrics, &snapshot, &metrics->textfile_rate,
+              &progress);
+          metrics_write_textfile(metrics, &snapshot, &progress);
+        }
+    }
+
+  // final state
+  if (metrics->textfile != NULL)
+    {
+      metrics_refresh(metrics, &snapshot, &metrics->textfile_rate, &progress);
+      metrics_write_textfile(metrics, &snapshot, &progress);
+    }
+
+  return NULL;
+}
+
+/**
+ * start the thread publishing metrics
+ */
+void
+metrics_start(struct metrics_t* metrics, const char* device,
+    const char* textfile, const char* socket_path, double interval,
+    metrics_render_t render, double render_interval)
+{
+  memset(&metrics->snapshot, 0, sizeof(struct metrics_snapshot_t));
+  metrics->device = device;
+  metrics->textfile = textfile;
+  metrics->socket_path = socket_path;
+  metrics->interval = interval;
+  metrics->render = render;
+  metrics->render_interval = render_interval;
+  metrics->listen_fd = -1;
+  metrics->start = metrics_now();
+  metrics->last_progress = 0;
+  metrics->phase_start = metrics->start;
+  metrics->phase_bytes = 0;
+  memset(&metrics->textfile_rate, 0, sizeof(struct metrics_rate_t));
+  memset(&metrics->socket_rate, 0, sizeof(struct metrics_rate_t));
+  memset(&metrics->render_rate, 0, sizeof(struct metrics_rate_t));
+  metrics->textfile_rate.time = metrics->start;
+  metrics->socket_rate.time = metrics->start;
+  metrics->render_rate.time = metrics->start;
+
+  if (pthread_mutex_init(&metrics->lock, NULL) != 0)
+    errx(EXIT_FAILURE, "metrics: can't create mutex");
+
+  if (pipe(metrics->wakeup) != 0)
+    err(EXIT_FAILURE, "metrics: pipe");
+
+  if (socket_path != NULL)
+    {
+      struct sockaddr_un addr;
+
+      if (strlen(socket_path) >= sizeof(addr.sun_path))
+        errx(EXIT_FAILURE, "metrics: socket path too long: %s", socket_path);
+
+      memset(&addr, 0, sizeof(addr));
+      addr.sun_family = AF_UNIX;
+      strcpy(addr.sun_path, socket_path);
+
+      metrics->listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+      if (metrics->listen_fd < 0)
+        err(EXIT_FAILURE, "metrics: socket");
+      unlink(socket_path);
+      if (bind(metrics->listen_fd, (struct sockaddr *)&addr,
+            sizeof(addr)) != 0)
+        err(EXIT_FAILURE, "metrics: %s", socket_path);
+      if (listen(metrics->listen_fd, 16) != 0)
+        err(EXIT_FAILURE, "metrics: listen");
+    }
+
+  if (pthread_create(&metrics->thread, NULL, metrics_thread, metrics) != 0)
+    errx(EXIT_FAILURE, "metrics: can't create thread");
+}
+
+/**
+ * make new state available to the metrics thread
+ */
+void
+metrics_publish(struct metrics_t* metrics,
+    const struct metrics_snapshot_t* snapshot)
+{
+  if (pthread_mutex_trylock(&metrics->lock) != 0)
+    return;
+
+  memcpy(&metrics->snapshot, snapshot, sizeof(struct metrics_snapshot_t));
+  pthread_mutex_unlock(&metrics->lock);
+}
+
+/**
+ * make new state available to the metrics thread, wait if the thread is
+ * reading previous snapshot
+ */
+void
+metrics_set(struct metrics_t* metrics,
+    const struct metrics_snapshot_t* snapshot)
+{
+  pthread_mutex_lock(&metrics->lock);
+  if (snapshot->phase != metrics->snapshot.phase)
+    {
+      metrics->phase_start = metrics_now();
+      metrics->phase_bytes = snapshot->bytes_read;
+      metrics->last_progress = 0;
+    }
+  memcpy(&metrics->snapshot, snapshot, sizeof(struct metrics_snapshot_t));
+  pthread_mutex_unlock(&metrics->lock);
+}
+
+/**
+ * publish the final state, stop the thread and remove the socket
+ */
+void
+metrics_stop(struct metrics_t* metrics,
+    const struct metrics_snapshot_t* snapshot)
+{
+  metrics_set(metrics, snapshot);
+
+  if (write(metrics->wakeup[1], "", 1) != 1)
+    err(EXIT_FAILURE, "metrics: write");
+  pthread_join(metrics->thread, NULL);
+
+  close(metrics->wakeup[0]);
+  close(metrics->wakeup[1]);
+  if (metrics->listen_fd >= 0)
+    {
+      close(metrics->listen_fd);
+      unlink(metrics->socket_path);
+    }
+  pthread_mutex_destroy(&metrics->lock);
+}
@@ -0,0 +1,166 @@
+/** hdck - hard drive low-level error and badsector checking
+ *
+ * Copyright (C) 2010  Hubert Kario
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#ifndef __METRICS_H
+#define __METRICS_H 1
+
+#include <pthread.h>
+
+/// number of bins in the histogram of read latencies
+#define METRICS_LATENCY_BINS 60
+/// upper bound of the first latency bin, in ms
+#define METRICS_MIN_LATENCY 0.01
+/// number of latency bins per decade
+#define METRICS_BINS_PER_DECADE 10
+/// number of block speed classes, from very very fast to very very slow
+#define METRICS_CLASSES 7
+
+/// part of the test the snapshot comes from
+enum {
+    METRICS_STARTING = 0,
+    METRICS_SCAN,
+    METRICS_REREAD,
+    METRICS_ANALYSIS,
+    METRICS_DONE
+};
+
+/// kind of status display for the snapshot
+enum {
+    METRICS_DISPLAY_NONE = 0, ///< nothing to display
+    METRICS_DISPLAY_SCAN, ///< sequential read of the disk
+    METRICS_DISPLAY_LIST ///< read of a list of blocks
+};
+
+/// state of the test, filled in by the I/O thread
+struct metrics_snapshot_t {
+    int phase; ///< part of the test running
+    int display; ///< kind of status display
+    long long loop; ///< number of current main loop, counted from 1
+    long long loops; ///< number of main loops to perform
+    int pass; ///< pass of progressive scan, counted from 1, 0 if none
+    int passes; ///< number of passes of progressive scan
+    long long lba; ///< sector read most recently
+    long long disk_sectors; ///< size of the disk in sectors
+    double progress; ///< completed part of current phase, from 0 to 1
+    long long bytes_read; ///< amount of data read so far
+    double thresholds[METRICS_CLASSES - 1]; ///< class boundaries, in ms
+    long long reads[METRICS_CLASSES]; ///< number of reads in every class
+    long long blocks[METRICS_CLASSES]; ///< number of blocks in every class
+    long long error_blocks; ///< number of blocks with read errors
+    long long timeout_blocks; ///< number of blocks with reads that timed out
+    long long errors; ///< number of read errors
+    long long timeouts; ///< number of reads that timed out
+    long long interrupts; ///< number of interrupted reads
+    long long invalid; ///< number of blocks with useless data
+    double latency_sum; ///< sum of read times, in ms
+    /** histogram of read times, the first bin includes all faster reads,
+     * the last one all slower reads */
+    long long latency[METRICS_LATENCY_BINS];
+};
+
+/// values derived from snapshots by the metrics thread
+struct metrics_progress_t {
+    double elapsed; ///< time since start of current phase, in seconds
+    double eta; ///< expected time to the end of current phase, NaN if unknown
+    double speed; ///< read speed since previous refresh, in MiB/s
+    double average_speed; ///< read speed in current phase, in MiB/s
+};
+
+/// function drawing status of the test
+typedef void (*metrics_render_t)(const struct metrics_snapshot_t* snapshot,
+    const struct metrics_progress_t* progress);
+
+/// read speed measurement for single consumer of snapshots
+struct metrics_rate_t {
+    double time; ///< time of previous refresh
+    long long bytes; ///< bytes read at previous refresh
+    double speed; ///< read speed between last two refreshes, in MiB/s
+};
+
+/// metrics publisher and status renderer
+struct metrics_t {
+    pthread_mutex_t lock; ///< guards snapshot
+    struct metrics_snapshot_t snapshot; ///< last published state
+    const char* device; ///< name of tested device, used as label
+    const char* textfile; ///< file to write metrics to, may be NULL
+    const char* socket_path; ///< Unix socket to serve metrics on, may be NULL
+    double interval; ///< how often to refresh the textfile, in seconds
+    int listen_fd; ///< listening socket, -1 if none
+    int wakeup[2]; ///< pipe used to stop the thread
+    pthread_t thread; ///< thread writing and serving the metrics
+    metrics_render_t render; ///< status display, may be NULL
+    double render_interval; ///< how often to draw the status, in seconds
+    double start; ///< time the publisher was started
+    double last_progress; ///< progress seen at previous refresh
+    double phase_start; ///< time the current phase started
+    long long phase_bytes; ///< bytes read before the current phase
+    struct metrics_rate_t textfile_rate; ///< read speed for textfile
+    struct metrics_rate_t socket_rate; ///< read speed for socket clients
+    struct metrics_rate_t render_rate; ///< read speed for status display
+};
+
+/**
+ * return histogram bin for read time
+ * @param time read time in ms
+ */
+int
+metrics_latency_bin(double time);
+
+/**
+ * start the thread publishing metrics and drawing status of the test
+ *
+ * The thread runs with idle CPU and IO priority, outside of the CPU the
+ * test is pinned to, so it doesn't change the timing of reads.
+ *
+ * @param render function drawing the status, called with the snapshot
+ * locked, NULL if status isn't displayed
+ * @param render_interval how often to draw the status, in seconds
+ */
+void
+metrics_start(struct metrics_t* metrics, const char* device,
+    const char* textfile, const char* socket_path, double interval,
+    metrics_render_t render, double render_interval);
+
+/**
+ * make new state available to the metrics thread
+ *
+ * Never blocks, when the thread is busy reading previous snapshot the update
+ * is dropped: the next one will carry the same counters.
+ */
+void
+metrics_publish(struct metrics_t* metrics,
+    const struct metrics_snapshot_t* snapshot);
+
+/**
+ * make new state available to the metrics thread, wait if the thread is
+ * reading previous snapshot
+ *
+ * After it returns, the status display doesn't show older state, so the
+ * caller can write to the terminal.
+ */
+void
+metrics_set(struct metrics_t* metrics,
+    const struct metrics_snapshot_t* snapshot);
+
+/**
+ * publish the final state, stop the thread and remove the socket
+ */
+void
+metrics_stop(struct metrics_t* metrics,
+    const struct metrics_snapshot_t* snapshot);
+
+#endif
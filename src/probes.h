@@ -0,0 +1,58 @@
+/** hdck - hard drive low-level error and badsector checking
+ *
+ * Copyright (C) 2010  Hubert Kario
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#ifndef __PROBES_H
+#define __PROBES_H 1
+
+/*
+ * Static tracepoints (USDT) for tracing hdck with perf, bpftrace or
+ * SystemTap, all in the "hdck" provider. When not traced they compile to a
+ * single nop; without sys/sdt.h they compile to nothing.
+ *
+ * read__start(lba, sectors)          read (or ATA VERIFY) is issued
+ * read__done(lba, sectors, result)   it finished, result is number of bytes
+ *                                    read or -1 on error
+ * interference(block, reads, writes) other disk activity detected during
+ *                                    timed read, with number of reads and
+ *                                    writes seen in disk stats
+ * invalidate(block, count)           last count blocks before block lost
+ *                                    their last sample because of
+ *                                    interference
+ * chunk__start(block, len)           re-read of a range of blocks starts
+ * chunk__done(block, len, valid)     it finished, valid is 0 when it was
+ *                                    interrupted
+ * max__len(len, successful)          length of re-read ranges changed, with
+ *                                    number of successful last 16 re-reads
+ *
+ * For example:
+ * bpftrace -e 'usdt:./hdck:hdck:interference { @[arg1, arg2] = count(); }'
+ */
+
+#ifdef HAVE_SYS_SDT_H
+#include <sys/sdt.h>
+
+#define HDCK_PROBE2(name, a1, a2) \
+  DTRACE_PROBE2(hdck, name, (long long)(a1), (long long)(a2))
+#define HDCK_PROBE3(name, a1, a2, a3) \
+  DTRACE_PROBE3(hdck, name, (long long)(a1), (long long)(a2), \
+      (long long)(a3))
+#else
+#define HDCK_PROBE2(name, a1, a2) do { } while (0)
+#define HDCK_PROBE3(name, a1, a2, a3) do { } while (0)
+#endif
+
+#endif
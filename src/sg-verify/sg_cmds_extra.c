@@ -1436,6 +1436,20 @@ sg_ll_verify10(int sg_fd, int vrprotect, int dpo, int bytechk,
                unsigned int lba, int veri_len, void * data_out,
                int data_out_len, unsigned int * infop, int noisy,
                int verbose)
+{
+    return sg_ll_verify10_timeout(sg_fd, vrprotect, dpo, bytechk, lba,
+                                  veri_len, data_out, data_out_len,
+                                  DEF_PT_TIMEOUT, infop, noisy, verbose);
+}
+
+/* Invokes a SCSI VERIFY (10) command (SBC and MMC) that is aborted after
+ * 'timeout_secs' seconds. Return values as for sg_ll_verify10(), plus
+ * SG_LIB_CAT_TIMEOUT -> command timed out */
+int
+sg_ll_verify10_timeout(int sg_fd, int vrprotect, int dpo, int bytechk,
+                       unsigned int lba, int veri_len, void * data_out,
+                       int data_out_len, int timeout_secs,
+                       unsigned int * infop, int noisy, int verbose)
 {
     int k, res, ret, sense_cat;
     unsigned char vCmdBlk[VERIFY10_CMDLEN] =
@@ -1468,7 +1482,15 @@ sg_ll_verify10(int sg_fd, int vrprotect, int dpo, int bytechk,
     set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
     if (data_out_len > 0)
         set_scsi_pt_data_out(ptvp, (unsigned char *)data_out, data_out_len);
-    res = do_scsi_pt(ptvp, sg_fd, DEF_PT_TIMEOUT, verbose);
+    res = do_scsi_pt(ptvp, sg_fd, timeout_secs, verbose);
+    /* host byte of the transport status is DID_TIME_OUT */
+    if ((SCSI_PT_DO_TIMEOUT == res) ||
+        (0 == res && 0x03 == ((get_scsi_pt_transport_err(ptvp) >> 8) & 0xff))) {
+        if (verbose)
+            fprintf(sg_warnings_strm, "verify (10): timeout\n");
+        destruct_scsi_pt_obj(ptvp);
+        return SG_LIB_CAT_TIMEOUT;
+    }
     ret = sg_cmds_process_resp(ptvp, "verify (10)", res, 0, sense_b,
                                noisy, verbose, &sense_cat);
     if (-1 == ret)
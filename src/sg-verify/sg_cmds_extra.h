@@ -213,6 +213,15 @@ extern int sg_ll_verify10(int sg_fd, int vrprotect, int dpo, int bytechk,
                           int data_out_len, unsigned int * infop, int noisy,
                           int verbose);
 
+/* Invokes a SCSI VERIFY (10) command (SBC and MMC) that is aborted after
+ * 'timeout_secs' seconds. Return values as for sg_ll_verify10(), plus
+ * SG_LIB_CAT_TIMEOUT -> command timed out */
+extern int sg_ll_verify10_timeout(int sg_fd, int vrprotect, int dpo,
+                                  int bytechk, unsigned int lba, int veri_len,
+                                  void * data_out, int data_out_len,
+                                  int timeout_secs, unsigned int * infop,
+                                  int noisy, int verbose);
+
 /* Invokes a SCSI WRITE BUFFER command (SPC). Return of 0 ->
  * success, SG_LIB_CAT_INVALID_OP -> invalid opcode,
  * SG_LIB_CAT_ILLEGAL_REQ -> bad field in cdb, SG_LIB_CAT_UNIT_ATTENTION,
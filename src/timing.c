@@ -0,0 +1,43 @@
+/** hdck - hard drive low-level error and badsector checking
+ *
+ * Copyright (C) 2010  Hubert Kario
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#define _GNU_SOURCE 1
+#include <stdint.h>
+#include <time.h>
+#include "timing.h"
+
+int64_t timing_overhead = 0;
+
+void
+timing_init(void)
+{
+  int64_t start, end, min = INT64_MAX;
+
+  timing_overhead = 0;
+
+  // the shortest interval is the fixed cost, longer ones were hit by
+  // interrupts or cache misses that real reads don't suffer from every time
+  for (int i=0; i < TIMING_CALIBRATION_READS; i++)
+    {
+      start = timing_now();
+      end = timing_now();
+      if (end - start < min)
+        min = end - start;
+    }
+
+  timing_overhead = min;
+}
@@ -0,0 +1,82 @@
+/** hdck - hard drive low-level error and badsector checking
+ *
+ * Copyright (C) 2010  Hubert Kario
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#ifndef __TIMING_H
+#define __TIMING_H 1
+
+#include <stdint.h>
+#include <time.h>
+
+/**
+ * clock used for timing reads, it isn't slewed by NTP so the length of a
+ * nanosecond doesn't change in the middle of a test
+ */
+#ifdef CLOCK_MONOTONIC_RAW
+#define TIMING_CLOCK CLOCK_MONOTONIC_RAW
+#else
+#define TIMING_CLOCK CLOCK_MONOTONIC
+#endif
+
+/// number of back-to-back clock readings used to measure their cost
+#define TIMING_CALIBRATION_READS 1000
+
+/**
+ * time between two back-to-back readings of the clock, in ns; it is
+ * included in every measured interval so it is subtracted from them
+ */
+extern int64_t timing_overhead;
+
+/**
+ * return current time of the timing clock, in ns
+ */
+static inline int64_t
+timing_now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(TIMING_CLOCK, &ts);
+  return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/**
+ * return time between two readings of the clock with the cost of reading
+ * the clock removed, in ns
+ */
+static inline int64_t
+timing_elapsed(int64_t start, int64_t end)
+{
+  int64_t res = end - start - timing_overhead;
+
+  return (res > 0) ? res : 0;
+}
+
+/**
+ * convert time in ns to ms, the unit of block_info and speed thresholds
+ */
+static inline double
+timing_ms(int64_t ns)
+{
+  return ns / 1E6;
+}
+
+/**
+ * measure cost of reading the clock, has to be called before any reads are
+ * timed
+ */
+void timing_init(void);
+
+#endif
@@ -0,0 +1,49 @@
+/** hdck - hard drive low-level error and badsector checking
+ *
+ * Copyright (C) 2010  Hubert Kario
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#ifndef __CHECK_H
+#define __CHECK_H 1
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+/// number of failed checks in the test program
+static int check_failures = 0;
+
+/// report failure when cond is false, continue with the following checks
+#define CHECK(cond) \
+  do { \
+    if (!(cond)) \
+      { \
+        fprintf(stderr, "%s:%i: check failed: %s\n", __FILE__, __LINE__, \
+            #cond); \
+        check_failures++; \
+      } \
+  } while (0)
+
+/// check that two doubles differ by at most eps
+#define CHECK_NEAR(a, b, eps) CHECK(fabs((a) - (b)) <= (eps))
+
+/// check that string haystack contains needle
+#define CHECK_CONTAINS(haystack, needle) \
+  CHECK(strstr((haystack), (needle)) != NULL)
+
+/// exit status of the test program
+#define CHECK_RESULT() ((check_failures == 0) ? 0 : 1)
+
+#endif
@@ -0,0 +1,137 @@
+/** hdck - hard drive low-level error and badsector checking
+ *
+ * Copyright (C) 2010  Hubert Kario
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include "block_list.h"
+#include "check.h"
+
+/**
+ * check that list holds exactly the ranges given as off, len pairs
+ */
+static int
+ranges_equal(struct block_ranges_t* list, const block_no_t* expected,
+    size_t len)
+{
+  if (list->len != len)
+    return 0;
+
+  for (size_t i=0; i < len; i++)
+    if (list->ranges[i].off != expected[2*i] ||
+        list->ranges[i].len != expected[2*i+1])
+      return 0;
+
+  return 1;
+}
+
+static void
+test_compact(void)
+{
+  struct block_ranges_t list;
+
+  br_init(&list);
+  br_add(&list, 50, 5);
+  br_add(&list, 10, 4);
+  br_add(&list, 12, 6); // partially overlapping
+  br_add(&list, 14, 2); // contained in the previous one
+  br_add(&list, 30, 1);
+  br_add(&list, 33, 2); // within glob from start of the previous one
+
+  br_sort(&list);
+  br_compact(&list, 4);
+  {
+    const block_no_t expected[] = { 10, 8, 30, 5, 50, 5 };
+    CHECK(ranges_equal(&list, expected, 3));
+  }
+  CHECK(br_blocks(&list) == 18);
+
+  br_clear(&list);
+  br_compact(&list, 4);
+  CHECK(list.len == 0);
+
+  br_free(&list);
+}
+
+static void
+test_extend(void)
+{
+  struct block_ranges_t list;
+
+  br_init(&list);
+  br_extend(&list, 5);
+  br_extend(&list, 6);
+  br_extend(&list, 8);
+  {
+    const block_no_t expected[] = { 5, 2, 8, 1 };
+    CHECK(ranges_equal(&list, expected, 2));
+  }
+  br_free(&list);
+}
+
+static void
+test_insert(void)
+{
+  struct block_ranges_t list;
+
+  br_init(&list);
+  CHECK(!br_contains(&list, 0));
+
+  br_insert(&list, 10);
+  br_insert(&list, 20);
+  br_insert(&list, 5);
+  {
+    const block_no_t expected[] = { 5, 1, 10, 1, 20, 1 };
+    CHECK(ranges_equal(&list, expected, 3));
+  }
+
+  // extends previous range, next range, then closes the gap
+  br_insert(&list, 11);
+  br_insert(&list, 19);
+  br_insert(&list, 12);
+  br_insert(&list, 18);
+  {
+    const block_no_t expected[] = { 5, 1, 10, 3, 18, 3 };
+    CHECK(ranges_equal(&list, expected, 3));
+  }
+  for (int i=13; i < 18; i++)
+    br_insert(&list, i);
+  {
+    const block_no_t expected[] = { 5, 1, 10, 11 };
+    CHECK(ranges_equal(&list, expected, 2));
+  }
+
+  // already present
+  br_insert(&list, 15);
+  CHECK(list.len == 2);
+
+  CHECK(br_contains(&list, 5));
+  CHECK(!br_contains(&list, 6));
+  CHECK(!br_contains(&list, 9));
+  CHECK(br_contains(&list, 10));
+  CHECK(br_contains(&list, 20));
+  CHECK(!br_contains(&list, 21));
+
+  br_free(&list);
+}
+
+int
+main(void)
+{
+  test_compact();
+  test_extend();
+  test_insert();
+
+  return CHECK_RESULT();
+}
@@ -0,0 +1,212 @@
+/** hdck - hard drive low-level error and badsector checking
+ *
+ * Copyright (C) 2010  Hubert Kario
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+// helpers of the main program are static, test them in the same unit
+#define main hdck_main
+#include "hdck.c"
+#undef main
+#include <sys/wait.h>
+#include "check.h"
+
+static void
+test_wilson_interval(void)
+{
+  double low, high;
+
+  wilson_interval(5, 10, 1.96, &low, &high);
+  CHECK_NEAR(low, 0.2366, 1E-4);
+  CHECK_NEAR(high, 0.7634, 1E-4);
+
+  // no successes still leave a chance some of the population is affected
+  wilson_interval(0, 10, 1.96, &low, &high);
+  CHECK(low == 0.0);
+  CHECK_NEAR(high, 0.2775, 1E-4);
+
+  wilson_interval(10, 10, 1.96, &low, &high);
+  CHECK_NEAR(low, 0.7225, 1E-4);
+  CHECK(high == 1.0);
+}
+
+/**
+ * fill block with fast samples followed by slow ones
+ */
+static void
+fill_block(struct block_info_t* block, size_t fast, size_t slow)
+{
+  bi_clear(block);
+  bi_init(block);
+  for (size_t i=0; i < fast; i++)
+    bi_add_time(block, 1.0);
+  for (size_t i=0; i < slow; i++)
+    bi_add_time(block, 10.0);
+}
+
+static void
+test_sprt_decide(void)
+{
+  struct status_t st;
+  struct block_info_t block;
+
+  memset(&st, 0, sizeof(st));
+  memset(&block, 0, sizeof(block));
+  st.min_reads = 3;
+  st.max_reads = 30;
+
+  fill_block(&block, 1, 1);
+  CHECK(sprt_decide(&st, &block, 5.0) == SPRT_CONTINUE);
+
+  fill_block(&block, 0, 2);
+  CHECK(sprt_decide(&st, &block, 5.0) == SPRT_SLOW);
+  // the same reads are fast in a slower zone
+  CHECK(sprt_decide(&st, &block, 20.0) == SPRT_CONTINUE);
+
+  fill_block(&block, 10, 0);
+  CHECK(sprt_decide(&st, &block, 5.0) == SPRT_HEALTHY);
+
+  // undecided test is cut short at the maximal number of reads
+  st.max_reads = 3;
+  fill_block(&block, 4, 1);
+  CHECK(sprt_decide(&st, &block, 5.0) == SPRT_CONTINUE);
+  fill_block(&block, 4, 2);
+  CHECK(sprt_decide(&st, &block, 5.0) == SPRT_SLOW);
+  fill_block(&block, 6, 0);
+  CHECK(sprt_decide(&st, &block, 5.0) == SPRT_HEALTHY);
+
+  bi_clear(&block);
+}
+
+static void
+test_next_block_range(void)
+{
+  struct block_ranges_t list;
+  struct block_range_t range;
+  size_t pos;
+
+  br_init(&list);
+  br_add(&list, 0, 1);
+  br_add(&list, 3, 1);
+  br_add(&list, 20, 2);
+  br_add(&list, 40, 1);
+
+  // entries closer than the gap are merged
+  pos = 0;
+  CHECK(next_block_range(&list, &pos, 1, 8, 5, &range) == 1);
+  CHECK(range.off == 0 && range.len == 4);
+  CHECK(next_block_range(&list, &pos, 1, 8, 5, &range) == 1);
+  CHECK(range.off == 20 && range.len == 2);
+  CHECK(next_block_range(&list, &pos, 1, 8, 5, &range) == 1);
+  CHECK(range.off == 40 && range.len == 1);
+  CHECK(next_block_range(&list, &pos, 1, 8, 5, &range) == 0);
+
+  // the same ranges from the end of the disk
+  pos = 0;
+  CHECK(next_block_range(&list, &pos, -1, 8, 5, &range) == 1);
+  CHECK(range.off == 40 && range.len == 1);
+  CHECK(next_block_range(&list, &pos, -1, 8, 5, &range) == 1);
+  CHECK(range.off == 20 && range.len == 2);
+  CHECK(next_block_range(&list, &pos, -1, 8, 5, &range) == 1);
+  CHECK(range.off == 0 && range.len == 4);
+  CHECK(next_block_range(&list, &pos, -1, 8, 5, &range) == 0);
+
+  // merged range doesn't grow over max_len
+  br_clear(&list);
+  br_add(&list, 0, 3);
+  br_add(&list, 4, 3);
+  br_add(&list, 8, 3);
+  pos = 0;
+  CHECK(next_block_range(&list, &pos, 1, 8, 5, &range) == 1);
+  CHECK(range.off == 0 && range.len == 7);
+  CHECK(next_block_range(&list, &pos, 1, 8, 5, &range) == 1);
+  CHECK(range.off == 8 && range.len == 3);
+
+  br_free(&list);
+}
+
+static void
+test_reread_merge_gap(void)
+{
+  struct status_t st;
+
+  memset(&st, 0, sizeof(st));
+  st.rotational_delay = 60.0 * 1000 / 7200;
+
+  // half a revolution of seek and 4 blocks of warm-up and trailing reads
+  CHECK(reread_merge_gap(&st) == 6);
+  // the gap doesn't depend on the speed of the disk
+  st.rotational_delay = 60.0 * 1000 / 5400;
+  CHECK(reread_merge_gap(&st) == 6);
+  // USB bridges need 15 more warm-up blocks
+  st.usb_mode = 1;
+  CHECK(reread_merge_gap(&st) == 21);
+}
+
+static void
+test_profiles(void)
+{
+  struct status_t st;
+  char path[64], lock_path[72], model[32];
+  const int instances = 16;
+
+  memset(&st, 0, sizeof(st));
+  snprintf(path, sizeof(path), "/tmp/hdck-test-profiles.%i", (int)getpid());
+  unlink(path);
+
+  // instances saving profiles of different models at the same time don't
+  // lose each other's profiles
+  for (int i=0; i < instances; i++)
+    if (fork() == 0)
+      {
+        snprintf(model, sizeof(model), "ATA MODEL%i 1.0", i);
+        st.rotational_delay = 1 + i;
+        for (int j=0; j < 3; j++)
+          save_profile(&st, path, model);
+        _exit(0);
+      }
+  for (int i=0; i < instances; i++)
+    wait(NULL);
+
+  for (int i=0; i < instances; i++)
+    {
+      snprintf(model, sizeof(model), "ATA MODEL%i 1.0", i);
+      st.rotational_delay = 0;
+      CHECK(load_profile(&st, path, model) == 0);
+      CHECK(st.rotational_delay == 1 + i);
+    }
+
+  // saving again replaces the profile
+  st.rotational_delay = 42;
+  save_profile(&st, path, "ATA MODEL0 1.0");
+  st.rotational_delay = 0;
+  CHECK(load_profile(&st, path, "ATA MODEL0 1.0") == 0);
+  CHECK(st.rotational_delay == 42);
+
+  unlink(path);
+  snprintf(lock_path, sizeof(lock_path), "%s.lock", path);
+  unlink(lock_path);
+}
+
+int
+main(void)
+{
+  test_wilson_interval();
+  test_sprt_decide();
+  test_next_block_range();
+  test_reread_merge_gap();
+  test_profiles();
+
+  return CHECK_RESULT();
+}
@@ -0,0 +1,109 @@
+/** hdck - hard drive low-level error and badsector checking
+ *
+ * Copyright (C) 2010  Hubert Kario
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <stdlib.h>
+#include <err.h>
+#include "json_writer.h"
+#include "check.h"
+
+/**
+ * read whole content of file written so far into buffer
+ */
+static void
+read_back(FILE* file, char* buffer, size_t len)
+{
+  size_t nread;
+
+  rewind(file);
+  nread = fread(buffer, 1, len - 1, file);
+  buffer[nread] = '\0';
+}
+
+static void
+test_escaping(void)
+{
+  struct json_writer_t json;
+  char buffer[512];
+  FILE* file = tmpfile();
+
+  if (file == NULL)
+    err(EXIT_FAILURE, "tmpfile");
+
+  json_init(&json, file);
+  json_begin_object(&json, NULL);
+  json_string(&json, "quote", "say \"hi\"");
+  json_string(&json, "back\\slash", "C:\\dev");
+  json_string(&json, "control", "a\nb\tc\x01");
+  json_string(&json, "utf8", "µs");
+  json_string(&json, "null", NULL);
+  json_end_object(&json);
+
+  read_back(file, buffer, sizeof(buffer));
+  CHECK_CONTAINS(buffer, "\"quote\": \"say \\\"hi\\\"\"");
+  CHECK_CONTAINS(buffer, "\"back\\\\slash\": \"C:\\\\dev\"");
+  CHECK_CONTAINS(buffer, "\"control\": \"a\\nb\\u0009c\\u0001\"");
+  CHECK_CONTAINS(buffer, "\"utf8\": \"µs\"");
+  CHECK_CONTAINS(buffer, "\"null\": null");
+
+  fclose(file);
+}
+
+static void
+test_structure(void)
+{
+  struct json_writer_t json;
+  char buffer[512];
+  FILE* file = tmpfile();
+
+  if (file == NULL)
+    err(EXIT_FAILURE, "tmpfile");
+
+  json_init(&json, file);
+  json_begin_object(&json, NULL);
+  json_begin_array(&json, "empty");
+  json_end_array(&json);
+  json_begin_array(&json, "values");
+  json_int(&json, NULL, -3);
+  json_double(&json, NULL, 0.1);
+  json_double(&json, NULL, NAN);
+  json_bool(&json, NULL, 1);
+  json_end_array(&json);
+  json_end_object(&json);
+
+  read_back(file, buffer, sizeof(buffer));
+  CHECK(strcmp(buffer,
+        "{\n"
+        "  \"empty\": [],\n"
+        "  \"values\": [\n"
+        "    -3,\n"
+        "    0.10000000000000001,\n"
+        "    null,\n"
+        "    true\n"
+        "  ]\n"
+        "}\n") == 0);
+
+  fclose(file);
+}
+
+int
+main(void)
+{
+  test_escaping();
+  test_structure();
+
+  return CHECK_RESULT();
+}
@@ -0,0 +1,117 @@
+/** hdck - hard drive low-level error and badsector checking
+ *
+ * Copyright (C) 2010  Hubert Kario
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+// the renderer is static, test it together with the rest of the module
+#include "metrics.c"
+#include "check.h"
+
+static void
+test_latency_bins(void)
+{
+  struct metrics_snapshot_t snapshot;
+
+  CHECK(metrics_latency_bin(0.0) == 0);
+  CHECK(metrics_latency_bin(METRICS_MIN_LATENCY) == 0);
+  // one decade above the minimum
+  CHECK(metrics_latency_bin(0.11) == METRICS_BINS_PER_DECADE);
+  CHECK(metrics_latency_bin(1E9) == METRICS_LATENCY_BINS - 1);
+
+  memset(&snapshot, 0, sizeof(snapshot));
+  CHECK(isnan(metrics_quantile(&snapshot, 0.5)));
+
+  snapshot.latency[metrics_latency_bin(1.5)] = 90;
+  snapshot.latency[metrics_latency_bin(50.0)] = 10;
+  // quantiles are reported as upper bound of the bin
+  CHECK(metrics_quantile(&snapshot, 0.5) >= 1.5);
+  CHECK(metrics_quantile(&snapshot, 0.5) < 1.5 * 1.26);
+  CHECK(metrics_quantile(&snapshot, 0.99) >= 50.0);
+  CHECK(metrics_quantile(&snapshot, 0.99) < 50.0 * 1.26);
+}
+
+static void
+test_write(void)
+{
+  struct metrics_t metrics;
+  struct metrics_snapshot_t snapshot;
+  struct metrics_progress_t progress;
+  char buffer[16384];
+  size_t nread;
+  FILE* file = tmpfile();
+
+  if (file == NULL)
+    err(EXIT_FAILURE, "tmpfile");
+
+  memset(&metrics, 0, sizeof(metrics));
+  metrics.device = "/dev/sdz";
+  metrics.start = metrics_now();
+
+  memset(&snapshot, 0, sizeof(snapshot));
+  snapshot.phase = METRICS_REREAD;
+  snapshot.loop = 2;
+  snapshot.loops = 3;
+  snapshot.lba = 1024;
+  snapshot.progress = 0.25;
+  snapshot.bytes_read = 1048576;
+  for (int i=0; i < METRICS_CLASSES - 1; i++)
+    snapshot.thresholds[i] = i + 1;
+  snapshot.reads[3] = 7;
+  snapshot.blocks[6] = 2;
+  snapshot.error_blocks = 1;
+  snapshot.errors = 4;
+  snapshot.latency[metrics_latency_bin(2.0)] = 5;
+  snapshot.latency_sum = 10.0;
+
+  progress.elapsed = 1.0;
+  progress.eta = 3.0;
+  progress.speed = 1.0;
+  progress.average_speed = 1.0;
+
+  metrics_write(&metrics, &snapshot, &progress, file);
+
+  rewind(file);
+  nread = fread(buffer, 1, sizeof(buffer) - 1, file);
+  buffer[nread] = '\0';
+  fclose(file);
+
+  CHECK_CONTAINS(buffer, "# TYPE hdck_phase gauge\n");
+  CHECK_CONTAINS(buffer, "hdck_phase{device=\"/dev/sdz\",phase=\"reread\"} 1\n");
+  CHECK_CONTAINS(buffer, "hdck_phase{device=\"/dev/sdz\",phase=\"scan\"} 0\n");
+  CHECK_CONTAINS(buffer, "hdck_loop{device=\"/dev/sdz\"} 2\n");
+  CHECK_CONTAINS(buffer, "hdck_progress_ratio{device=\"/dev/sdz\"} 0.250000\n");
+  CHECK_CONTAINS(buffer, "hdck_eta_seconds{device=\"/dev/sdz\"} 3\n");
+  CHECK_CONTAINS(buffer, "hdck_class_threshold_milliseconds{device=\"/dev/sdz\","
+      "class=\"vvfast\"} 1.000\n");
+  CHECK_CONTAINS(buffer, "hdck_reads_total{device=\"/dev/sdz\","
+      "class=\"normal\"} 7\n");
+  CHECK_CONTAINS(buffer, "hdck_blocks{device=\"/dev/sdz\",class=\"vvslow\"} 2\n");
+  CHECK_CONTAINS(buffer, "hdck_blocks{device=\"/dev/sdz\",class=\"error\"} 1\n");
+  CHECK_CONTAINS(buffer, "hdck_read_errors_total{device=\"/dev/sdz\"} 4\n");
+  CHECK_CONTAINS(buffer, "# TYPE hdck_read_latency_milliseconds summary\n");
+  CHECK_CONTAINS(buffer, "hdck_read_latency_milliseconds_sum{device=\"/dev/sdz\"}"
+      " 10.000\n");
+  CHECK_CONTAINS(buffer, "hdck_read_latency_milliseconds_count{device="
+      "\"/dev/sdz\"} 5\n");
+}
+
+int
+main(void)
+{
+  test_latency_bins();
+  test_write();
+
+  return CHECK_RESULT();
+}